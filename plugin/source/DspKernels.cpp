@@ -0,0 +1,229 @@
+#include "DspKernels.h"
+#include <JuceHeader.h>
+#include <atomic>
+
+// Variants are stamped out with target attributes rather than per-file -m flags. Shared inline
+// helpers (fastmath, phase) then stay compiled for the baseline everywhere they are emitted out of
+// line, and only get the wider instructions once inlined into a variant, so no AVX code can leak
+// into the generic path through the linker picking one of several inline definitions.
+#if JUCE_INTEL && (JUCE_GCC || JUCE_CLANG)
+#define FMSYNTH_KERNEL_DISPATCH 1
+#else
+#define FMSYNTH_KERNEL_DISPATCH 0
+#endif
+
+namespace kernels
+{
+    namespace
+    {
+        // One sample of every voice. The arrays never overlap, __restrict lets the compiler skip the
+        // runtime alias checks it cannot afford for this many pointers and vectorize across voices.
+        template <typename T, fastmath::SineAccuracy Accuracy>
+        forcedinline void renderVoiceSample (phase::Accumulator* __restrict carrierPhases,
+                                             const phase::Accumulator* __restrict carrierIncrements,
+                                             phase::Accumulator* __restrict modulatorPhases,
+                                             const phase::Accumulator* __restrict modulatorIncrements,
+                                             T* __restrict modulationIndices,
+                                             const T* __restrict modulationIndexSteps,
+                                             T* __restrict levels,
+                                             const T* __restrict levelSteps,
+                                             T* __restrict scratch,
+                                             int numVoices)
+        {
+            for (int v = 0; v < numVoices; ++v)
+            {
+                const auto modulator = fastmath::sinCycles<Accuracy> (phase::toCycles<T> (modulatorPhases[v]));
+                const auto carrierCycles = phase::toCycles<T> (carrierPhases[v]) + modulationIndices[v] * modulator;
+                scratch[v] = fastmath::sinCycles<Accuracy> (carrierCycles) * levels[v];
+
+                carrierPhases[v] += carrierIncrements[v];
+                modulatorPhases[v] += modulatorIncrements[v];
+                modulationIndices[v] += modulationIndexSteps[v];
+                levels[v] += levelSteps[v];
+            }
+        }
+
+        // Voice outputs are summed in voiceBlockSize wide partial sums, which keeps the reduction vectorized without fast-math
+        template <typename T>
+        forcedinline T sumVoices (const T* scratch, const T* gains, int numVoices)
+        {
+            std::array<T, voiceBlockSize> partialSums {};
+            if (gains == nullptr)
+            {
+                for (int v = 0; v < numVoices; v += voiceBlockSize)
+                    for (int k = 0; k < voiceBlockSize; ++k)
+                        partialSums[(size_t) k] += scratch[v + k];
+            }
+            else
+            {
+                for (int v = 0; v < numVoices; v += voiceBlockSize)
+                    for (int k = 0; k < voiceBlockSize; ++k)
+                        partialSums[(size_t) k] += scratch[v + k] * gains[v + k];
+            }
+
+            T sum = 0;
+            for (auto partialSum : partialSums)
+                sum += partialSum;
+            return sum;
+        }
+
+        // The work per sample is spread across voices, so it fills whole vector registers however
+        // short the block is. Mono output skips the panning entirely.
+        template <typename T, fastmath::SineAccuracy Accuracy>
+        forcedinline void voices (const VoiceLanes<T>& lanes, T* left, T* right, int numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                renderVoiceSample<T, Accuracy> (lanes.carrierPhases,
+                                                lanes.carrierIncrements,
+                                                lanes.modulatorPhases,
+                                                lanes.modulatorIncrements,
+                                                lanes.modulationIndices,
+                                                lanes.modulationIndexSteps,
+                                                lanes.levels,
+                                                lanes.levelSteps,
+                                                lanes.scratch,
+                                                lanes.numVoices);
+
+                if (right == nullptr)
+                {
+                    left[i] = sumVoices<T> (lanes.scratch, nullptr, lanes.numVoices);
+                }
+                else
+                {
+                    left[i] = sumVoices<T> (lanes.scratch, lanes.leftGains, lanes.numVoices);
+                    right[i] = sumVoices<T> (lanes.scratch, lanes.rightGains, lanes.numVoices);
+                }
+            }
+        }
+
+#define FMSYNTH_DECLARE_KERNEL_VARIANT(Variant, TargetAttribute)                                                                 \
+    template <typename T, fastmath::SineAccuracy Accuracy>                                                                       \
+    TargetAttribute void voices##Variant (const VoiceLanes<T>& lanes, T* left, T* right, int numSamples)                         \
+    {                                                                                                                            \
+        voices<T, Accuracy> (lanes, left, right, numSamples);                                                                    \
+    }                                                                                                                            \
+                                                                                                                                 \
+    template <typename T>                                                                                                        \
+    Table<T> make##Variant##Table()                                                                                              \
+    {                                                                                                                            \
+        return { InstructionSet::Variant,                                                                                        \
+                 { &voices##Variant<T, fastmath::SineAccuracy::Fast>,                                                            \
+                   &voices##Variant<T, fastmath::SineAccuracy::Precise>,                                                         \
+                   &voices##Variant<T, fastmath::SineAccuracy::Exact> } };                                                       \
+    }
+
+        FMSYNTH_DECLARE_KERNEL_VARIANT (Generic, )
+#if FMSYNTH_KERNEL_DISPATCH
+        FMSYNTH_DECLARE_KERNEL_VARIANT (AVX2, __attribute__ ((target ("avx2"))))
+        FMSYNTH_DECLARE_KERNEL_VARIANT (AVX512, __attribute__ ((target ("avx512f"))))
+#endif
+
+#undef FMSYNTH_DECLARE_KERNEL_VARIANT
+
+        std::atomic<int> overrideIndex { -1 };
+
+        std::optional<InstructionSet> getEnvironmentOverride()
+        {
+            static const auto environmentOverride = []() -> std::optional<InstructionSet>
+            {
+                const auto value = juce::SystemStats::getEnvironmentVariable ("FMSYNTH_ISA", {}).trim().toLowerCase();
+                if (value == "generic" || value == "sse2")
+                    return InstructionSet::Generic;
+                if (value == "avx2")
+                    return InstructionSet::AVX2;
+                if (value == "avx512")
+                    return InstructionSet::AVX512;
+                return std::nullopt;
+            }();
+            return environmentOverride;
+        }
+    } // namespace
+
+    bool isSupported (InstructionSet instructionSet)
+    {
+        switch (instructionSet)
+        {
+            case InstructionSet::Generic:
+                return true;
+#if FMSYNTH_KERNEL_DISPATCH
+            case InstructionSet::AVX2:
+                return juce::SystemStats::hasAVX2();
+            case InstructionSet::AVX512:
+                return juce::SystemStats::hasAVX512F();
+#else
+            case InstructionSet::AVX2:
+            case InstructionSet::AVX512:
+                break;
+#endif
+        }
+        return false;
+    }
+
+    void setOverride (std::optional<InstructionSet> instructionSet)
+    {
+        overrideIndex.store (instructionSet.has_value() ? (int) *instructionSet : -1);
+    }
+
+    InstructionSet getSelectedInstructionSet()
+    {
+        const auto index = overrideIndex.load();
+        const auto requested = index >= 0 ? std::optional<InstructionSet> ((InstructionSet) index) : getEnvironmentOverride();
+
+        if (requested.has_value() && isSupported (*requested))
+            return *requested;
+
+        for (auto candidate : { InstructionSet::AVX512, InstructionSet::AVX2 })
+            if (isSupported (candidate))
+                return candidate;
+
+        return InstructionSet::Generic;
+    }
+
+    template <typename T>
+    const Table<T>& get (InstructionSet instructionSet)
+    {
+        static const Table<T> generic = makeGenericTable<T>();
+#if FMSYNTH_KERNEL_DISPATCH
+        static const Table<T> avx2 = makeAVX2Table<T>();
+        static const Table<T> avx512 = makeAVX512Table<T>();
+
+        // Never hand out a variant the CPU would fault on
+        if (isSupported (instructionSet))
+        {
+            if (instructionSet == InstructionSet::AVX2)
+                return avx2;
+            if (instructionSet == InstructionSet::AVX512)
+                return avx512;
+        }
+#else
+        juce::ignoreUnused (instructionSet);
+#endif
+        return generic;
+    }
+
+    template <typename T>
+    const Table<T>& select()
+    {
+        return get<T> (getSelectedInstructionSet());
+    }
+
+    const char* getName (InstructionSet instructionSet)
+    {
+        switch (instructionSet)
+        {
+            case InstructionSet::Generic:
+                return "generic";
+            case InstructionSet::AVX2:
+                return "avx2";
+            case InstructionSet::AVX512:
+                return "avx512";
+        }
+        return "unknown";
+    }
+
+    template const Table<float>& get<float> (InstructionSet);
+    template const Table<double>& get<double> (InstructionSet);
+    template const Table<float>& select<float>();
+    template const Table<double>& select<double>();
+} // namespace kernels
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "FastMath.h"
+#include "Phase.h"
+#include <array>
+#include <optional>
+
+// Hot loops compiled for several instruction sets inside the same binary.
+//
+// select() picks the widest variant the CPU supports, unless an override is set (for tests) or the
+// FMSYNTH_ISA environment variable names one ("generic", "avx2", "avx512"). Generic is the
+// baseline of the build target, i.e. SSE2 on x86-64 and NEON on arm64.
+namespace kernels
+{
+    enum class InstructionSet
+    {
+        Generic,
+        AVX2,
+        AVX512
+    };
+
+    // Voice counts handed to the voice kernel are padded to a multiple of this
+    constexpr int voiceBlockSize = 16;
+
+    // Structure-of-arrays state of a voice bank (see VoiceBank.h). Every array holds numVoices entries.
+    // Phases, modulation indices and levels are advanced in place, by their increment or step per sample.
+    template <typename T>
+    struct VoiceLanes
+    {
+        phase::Accumulator* carrierPhases;
+        const phase::Accumulator* carrierIncrements;
+        phase::Accumulator* modulatorPhases;
+        const phase::Accumulator* modulatorIncrements;
+        T* modulationIndices; // cycles
+        const T* modulationIndexSteps;
+        T* levels; // amplitude and envelope
+        const T* levelSteps;
+        const T* leftGains; // panning, only read for stereo output
+        const T* rightGains;
+        T* scratch;
+        int numVoices;
+    };
+
+    template <typename T>
+    struct Table
+    {
+        // left[i] = sum over voices of level * sin (2 pi (carrier + index * sin (2 pi modulator))), one entry per SineAccuracy.
+        // With a right output both sums are weighted by the voice gains of their side, without it left is the mono sum.
+        using VoiceFunction = void (*) (const VoiceLanes<T>& lanes, T* left, T* right, int numSamples);
+
+        InstructionSet instructionSet;
+        std::array<VoiceFunction, 3> voices;
+
+        VoiceFunction getVoiceRenderer (fastmath::SineAccuracy accuracy) const { return voices[(size_t) accuracy]; }
+    };
+
+    bool isSupported (InstructionSet instructionSet);
+
+    // Forces a variant, falling back to the best supported one if the CPU cannot run it
+    void setOverride (std::optional<InstructionSet> instructionSet);
+
+    InstructionSet getSelectedInstructionSet();
+
+    template <typename T>
+    const Table<T>& select();
+
+    template <typename T>
+    const Table<T>& get (InstructionSet instructionSet);
+
+    const char* getName (InstructionSet instructionSet);
+} // namespace kernels
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+// Immutable DSP data shared by every plugin instance in the process.
+//
+// Tables that only depend on the sample rate and the build configuration are built once per key and
+// handed out as shared_ptr<const DspResources>, so a session of 200 instances at one rate holds one
+// copy instead of 200. The cache keeps weak references only: a table lives as long as some instance
+// is prepared with its key. Lookups take a lock and may build a table, so they belong in prepare(),
+// never on the audio thread.
+struct DspResources
+{
+    static constexpr int numMidiNotes = 128;
+
+    struct Key
+    {
+        double sampleRate;
+        double tuningFrequency; // A4, Hz
+
+        bool operator< (const Key& other) const
+        {
+            return std::tie (sampleRate, tuningFrequency) < std::tie (other.sampleRate, other.tuningFrequency);
+        }
+    };
+
+    explicit DspResources (const Key& resourceKey) : key (resourceKey)
+    {
+        for (int note = 0; note < numMidiNotes; ++note)
+            noteCycles[(size_t) note] = key.tuningFrequency * std::exp2 ((note - 69) / 12.0) / key.sampleRate;
+    }
+
+    const Key key;
+
+    // Equal tempered frequency of every MIDI note, in cycles per sample
+    std::array<double, numMidiNotes> noteCycles;
+};
+
+// Held through juce::SharedResourcePointer, which creates it with the first instance and deletes it with the last
+class DspResourceCache
+{
+public:
+    static constexpr double defaultTuningFrequency = 440.0;
+
+    std::shared_ptr<const DspResources> get (double sampleRate, double tuningFrequency = defaultTuningFrequency)
+    {
+        const DspResources::Key key { sampleRate, tuningFrequency };
+        const std::lock_guard<std::mutex> guard (lock);
+
+        auto& entry = resources[key];
+        if (auto existing = entry.lock())
+            return existing;
+
+        // Entries of released tables are only pruned here, there are rarely more than a handful of rates
+        for (auto it = resources.begin(); it != resources.end();)
+            it = it->second.expired() && &it->second != &entry ? resources.erase (it) : std::next (it);
+
+        auto created = std::make_shared<const DspResources> (key);
+        entry = created;
+        return created;
+    }
+
+    // Tables currently in use by some instance
+    int getNumLiveResources()
+    {
+        const std::lock_guard<std::mutex> guard (lock);
+        return (int) std::count_if (resources.begin(), resources.end(), [] (const auto& entry) { return ! entry.second.expired(); });
+    }
+
+private:
+    std::mutex lock;
+    std::map<DspResources::Key, std::weak_ptr<const DspResources>> resources;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+// Per-note expression lanes (pitch, pressure, timbre) for MPE and plain MIDI controllers.
+//
+// Voices are indexed by MIDI channel. Once an MPE Configuration Message (RPN 6 on channel 1) sets up a
+// lower zone, channel 1 is its master channel, whose pitch bend applies to every voice, and the member
+// channels carry one note each with the MPE bend range. Without a zone, or outside it, every channel is
+// a plain keyboard bending only its own notes by the master range, so a keyboard on any channel gets
+// its usual two semitones. The upper zone (master channel 16) is not supported, its channels play as
+// plain keyboards. One more voice, internalVoice, has no MIDI channel:
+// the plugin plays its own notes there (the resynthesis mode), out of reach of any controller. Each lane
+// is a contiguous per-voice array that
+// is smoothed once per block; the render code then ramps linearly across the block, so expression
+// costs one multiply-add per lane and sample.
+class ExpressionLanes
+{
+public:
+    static constexpr int numChannelVoices = 16;
+    static constexpr int internalVoice = numChannelVoices;
+    static constexpr int numVoices = numChannelVoices + 1;
+
+    enum Lane
+    {
+        Pitch,    // semitones
+        Pressure, // 0..1
+        Timbre,   // 0..1, CC74
+        numLanes
+    };
+
+    static constexpr int masterChannel = 1;
+    static constexpr float masterPitchBendRange = 2.0f;
+    static constexpr float memberPitchBendRange = 48.0f; // MPE default
+    static constexpr float defaultTimbre = 0.5f;
+
+    ExpressionLanes() { reset(); }
+
+    void reset()
+    {
+        for (auto& lane : targets)
+            lane.fill (0.0f);
+        targets[Timbre].fill (defaultTimbre);
+        values = targets;
+        velocities.fill (1.0f);
+        masterPitchTarget = masterPitch = 0.0f;
+        numMemberChannels = 0;
+        rpnNumbers.fill (nullRpn);
+    }
+
+    static int getVoiceForChannel (int midiChannel) { return juce::jlimit (0, numChannelVoices - 1, midiChannel - 1); }
+
+    // Channels 2 to numMemberChannels + 1, 0 until an MPE Configuration Message sets up the lower zone
+    int getNumMemberChannels() const { return numMemberChannels; }
+    bool isMemberChannel (int midiChannel) const { return midiChannel > masterChannel && midiChannel <= masterChannel + numMemberChannels; }
+
+    void handleMidiMessage (const juce::MidiMessage& message)
+    {
+        const auto voice = (size_t) getVoiceForChannel (message.getChannel());
+
+        if (message.isNoteOn())
+        {
+            noteOn ((int) voice, message.getFloatVelocity());
+        }
+        else if (message.isPitchWheel())
+        {
+            const auto bend = (float) (message.getPitchWheelValue() - 8192) / 8192.0f;
+            if (numMemberChannels > 0 && message.getChannel() == masterChannel)
+                masterPitchTarget = bend * masterPitchBendRange;
+            else
+                targets[Pitch][voice] = bend * (isMemberChannel (message.getChannel()) ? memberPitchBendRange : masterPitchBendRange);
+        }
+        else if (message.isChannelPressure())
+        {
+            targets[Pressure][voice] = (float) message.getChannelPressureValue() / 127.0f;
+        }
+        else if (message.isController())
+        {
+            handleController (message.getChannel(), message.getControllerNumber(), message.getControllerValue());
+        }
+    }
+
+    // What a note-on or an expression message does to one voice, for notes that don't arrive as MIDI (internalVoice)
+    void noteOn (int voice, float velocity)
+    {
+        // MPE sends the initial pressure/timbre before the note-on, a new note must not glide from the previous one
+        velocities[(size_t) voice] = velocity;
+        for (auto lane = 0; lane < numLanes; ++lane)
+            values[(size_t) lane][(size_t) voice] = targets[(size_t) lane][(size_t) voice];
+    }
+
+    void setTarget (Lane lane, int voice, float value) { targets[(size_t) lane][(size_t) voice] = value; }
+
+    // Control rate smoothing, called once per block
+    void advance (double seconds)
+    {
+        const auto coefficient = (float) (1.0 - std::exp (-seconds / smoothingTime));
+
+        for (size_t lane = 0; lane < (size_t) numLanes; ++lane)
+            for (size_t voice = 0; voice < (size_t) numVoices; ++voice)
+                values[lane][voice] += (targets[lane][voice] - values[lane][voice]) * coefficient;
+
+        masterPitch += (masterPitchTarget - masterPitch) * coefficient;
+    }
+
+    float getValue (Lane lane, int voice) const { return values[(size_t) lane][(size_t) voice]; }
+    const float* getValues (Lane lane) const { return values[(size_t) lane].data(); }
+    float getVelocity (int voice) const { return velocities[(size_t) voice]; }
+
+    // Carrier (and modulator) frequency multiplier
+    double getPitchRatio (int voice) const { return std::exp2 ((double) (masterPitch + getValue (Pitch, voice)) / 12.0); }
+
+    // main_mod_amplitude multiplier: 1 for a centred CC74 and no pressure, pressing or raising CC74 brightens
+    float getModulationDepthScale (int voice) const
+    {
+        return (getValue (Timbre, voice) / defaultTimbre) * (1.0f + getValue (Pressure, voice));
+    }
+
+private:
+    static constexpr double smoothingTime = 0.01;
+    static constexpr int nullRpn = 0x3fff;
+    static constexpr int mpeConfigurationRpn = 6;
+
+    void handleController (int midiChannel, int controller, int value)
+    {
+        const auto voice = (size_t) getVoiceForChannel (midiChannel);
+        auto& rpn = rpnNumbers[voice];
+
+        switch (controller)
+        {
+            case 74:
+                targets[Timbre][voice] = (float) value / 127.0f;
+                break;
+            case 101: // RPN MSB
+                rpn = (value << 7) | (rpn & 0x7f);
+                break;
+            case 100: // RPN LSB
+                rpn = (rpn & ~0x7f) | value;
+                break;
+            case 6: // data entry MSB: the member channel count of an MPE Configuration Message, 0 ends the zone
+                if (midiChannel == masterChannel && rpn == mpeConfigurationRpn)
+                {
+                    numMemberChannels = juce::jlimit (0, numChannelVoices - 1, value);
+                    if (numMemberChannels == 0)
+                        masterPitchTarget = 0.0f;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::array<std::array<float, numVoices>, numLanes> targets;
+    std::array<std::array<float, numVoices>, numLanes> values;
+    std::array<float, numVoices> velocities;
+    float masterPitchTarget = 0.0f;
+    float masterPitch = 0.0f;
+
+    int numMemberChannels = 0;
+    std::array<int, numChannelVoices> rpnNumbers; // selected RPN per channel, the data entry it receives applies to it
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+// Range-reduced minimax sine approximations.
+//
+// The argument is reduced to a quarter cycle using only multiplies, adds and an absolute value,
+// and the sine is then evaluated as an odd polynomial whose coefficients are minimax fits from the
+// Remez exchange algorithm. The kernels are branch-free, so the block functions auto-vectorize
+// and the same templates can be instantiated with juce::dsp::SIMDRegister.
+namespace fastmath
+{
+    enum class SineAccuracy
+    {
+        Fast,    // ~-80 dB max error
+        Precise, // ~-120 dB max error
+        Exact    // within a few ulp of std::sin
+    };
+
+    namespace detail
+    {
+        constexpr double pi = 3.14159265358979323846;
+
+        // Minimax fits of x * P (x^2) to sin (pi / 2 * x) on [0, 1], N coefficients in P, from the Remez exchange
+        // algorithm. Fitted offline rather than in constexpr, which exceeds the evaluation limits of the compilers;
+        // FastMathTest re-runs the fit, compares it with these values and checks their error bounds.
+        template <std::size_t N>
+        constexpr std::array<double, N> quarterCycleFit()
+        {
+            if constexpr (N == 3) // -83.4 dB
+                return { 1.5703200191556692, -0.64211316699757393, 0.071860854242148789 };
+            else if constexpr (N == 4) // -124.6 dB
+                return { 1.5707910110755079, -0.64589284955095205, 0.079434344620204336, -0.0043330952929077002 };
+            else if constexpr (N == 6) // -217.5 dB
+                return { 1.5707963266218763,    -0.64596409265269661,   0.079692587335018217,
+                         -0.004681620350745699, 0.00016021724627292671, -3.4182130221497107e-06 };
+            else if constexpr (N == 8) // double rounding
+                return { 1.5707963267948932,     -0.64596409750611661,   0.079692626244571504,   -0.0046817541262952952,
+                         0.0001604411572673293,  -3.5987949215775755e-06, 5.6872814515986765e-08, -6.4221303234693065e-10 };
+            else
+                static_assert (N == 0, "no fit with this many terms, generate one with FastMathTest's remez()");
+        }
+
+        // Rescales the fit from [0, 1] (quarter cycles) to s in [-1/4, 1/4] cycles and negates it,
+        // because the reduction below evaluates -sin (2 pi s) to avoid a scalar-minus-vector op.
+        template <typename T, std::size_t N>
+        constexpr std::array<T, N> toCycleCoefficients (const std::array<double, N>& quarterCycle)
+        {
+            std::array<T, N> result {};
+            auto scale = 4.0;
+            for (std::size_t k = 0; k < N; ++k)
+            {
+                result[k] = (T) (-quarterCycle[k] * scale);
+                scale *= 16.0;
+            }
+            return result;
+        }
+
+        template <typename T>
+        constexpr std::size_t numSineTerms (SineAccuracy accuracy)
+        {
+            switch (accuracy)
+            {
+                case SineAccuracy::Fast:
+                    return 3;
+                case SineAccuracy::Precise:
+                    return 4;
+                case SineAccuracy::Exact:
+                    break;
+            }
+            return std::is_same_v<T, float> ? 6 : 8;
+        }
+
+        template <typename Vec>
+        struct Element
+        {
+            using Type = typename Vec::ElementType;
+        };
+
+        template <>
+        struct Element<float>
+        {
+            using Type = float;
+        };
+
+        template <>
+        struct Element<double>
+        {
+            using Type = double;
+        };
+
+        inline float abs (float x) { return std::abs (x); }
+        inline double abs (double x) { return std::abs (x); }
+
+        template <typename Vec>
+        inline Vec abs (Vec x)
+        {
+            return Vec::abs (x);
+        }
+
+        // Adding and subtracting 1.5 * 2^mantissaBits rounds to the nearest integer in the current
+        // rounding mode. Valid while |x| < 2^22 (float) or 2^51 (double), far beyond any phase we use.
+        template <typename T>
+        constexpr T roundingMagic = std::is_same_v<T, float> ? (T) 12582912.0 : (T) 6755399441055744.0;
+    } // namespace detail
+
+    template <typename T, SineAccuracy Accuracy>
+    inline constexpr auto sineCoefficients = detail::toCycleCoefficients<T> (detail::quarterCycleFit<detail::numSineTerms<T> (Accuracy)>());
+
+    // sin (2 pi * cycles). Vec is float, double or a SIMD register of either.
+    template <SineAccuracy Accuracy, typename Vec>
+    inline Vec sinCycles (Vec cycles)
+    {
+        using T = typename detail::Element<Vec>::Type;
+        constexpr auto& c = sineCoefficients<T, Accuracy>;
+        constexpr auto numTerms = c.size();
+
+        // Reduce to s in [-1/4, 1/4] with sin (2 pi cycles) == -sin (2 pi s)
+        const Vec shifted = cycles - (T) 0.25;
+        const Vec nearest = (shifted + detail::roundingMagic<T>) - detail::roundingMagic<T>;
+        const Vec s = detail::abs (shifted - nearest) - (T) 0.25;
+        const Vec s2 = s * s;
+
+        Vec p = s2 * c[numTerms - 1] + c[numTerms - 2];
+        for (std::size_t k = numTerms - 2; k-- > 0;)
+            p = p * s2 + c[k];
+
+        return s * p;
+    }
+
+    template <SineAccuracy Accuracy, typename Vec>
+    inline Vec cosCycles (Vec cycles)
+    {
+        using T = typename detail::Element<Vec>::Type;
+        return sinCycles<Accuracy> (cycles + (T) 0.25);
+    }
+
+    template <SineAccuracy Accuracy, typename Vec>
+    inline Vec sin (Vec radians)
+    {
+        using T = typename detail::Element<Vec>::Type;
+        return sinCycles<Accuracy> (radians * (T) (0.5 / detail::pi));
+    }
+
+    template <SineAccuracy Accuracy, typename Vec>
+    inline Vec cos (Vec radians)
+    {
+        using T = typename detail::Element<Vec>::Type;
+        return cosCycles<Accuracy> (radians * (T) (0.5 / detail::pi));
+    }
+
+    // Block variants, written so the compiler can vectorize the loop
+    template <SineAccuracy Accuracy, typename T>
+    inline void sinCycles (const T* cycles, T* output, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            output[i] = sinCycles<Accuracy> (cycles[i]);
+    }
+
+    template <SineAccuracy Accuracy, typename T>
+    inline void sin (const T* radians, T* output, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            output[i] = sin<Accuracy> (radians[i]);
+    }
+} // namespace fastmath
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "Expression.h"
+#include "SynthSignal.h"
+#include "VoiceBank.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Renders a MIDI timeline on all cores, sample-identical to a serial render.
+//
+// Oscillator phases and envelopes carry across blocks, so a long render cannot simply be cut anywhere.
+// A control-only pre-pass runs the MIDI, expression and envelopes without the oscillators (a few
+// percent of the cost) and finds the blocks at which no voice is sounding. At those blocks it stores a
+// checkpoint of the expression lanes and the voice bank; each chunk then restores its checkpoint and
+// renders independently on a worker thread, straight into its slice of the output.
+//
+// A serial render here means what AudioPluginAudioProcessor produces when called with blocks of
+// blockSize samples: MIDI events take effect at the start of the block they fall in, and the operator
+// parameters are read from the carrier Signal, so they must not change during the render.
+//
+// The timbre index renders its preset auditions through it (timbre::PresetRenderer), without building
+// an audio callback around the voice bank.
+template <typename SampleType>
+class OfflineRenderer
+{
+public:
+    OfflineRenderer (Signal<SampleType>& carrierSignal, fastmath::SineAccuracy sineAccuracy, double renderSampleRate, int renderBlockSize = 512)
+        : carrier (carrierSignal), accuracy (sineAccuracy), sampleRate (renderSampleRate), blockSize (renderBlockSize)
+    {
+        jassert (sampleRate > 0.0 && blockSize > 0);
+    }
+
+    // Renders numSamples samples of sequence (timestamps in samples) into left and right.
+    // numThreads <= 0 uses every core, 1 renders serially in one chunk and skips the pre-pass.
+    void render (const juce::MidiMessageSequence& sequence, SampleType* left, SampleType* right, int numSamples, int numThreads = 0)
+    {
+        const auto numBlocks = (numSamples + blockSize - 1) / blockSize;
+        collectBlockEvents (sequence, numBlocks);
+
+        if (numThreads <= 0)
+        {
+            numThreads = juce::SystemStats::getNumCpus();
+        }
+
+        // Several chunks per thread keeps the cores busy when some chunks are much denser than others
+        const auto minimumChunkBlocks = numThreads == 1 ? numBlocks : juce::jmax (1, numBlocks / (numThreads * chunksPerThread));
+        const auto chunks = findChunks (numSamples, minimumChunkBlocks);
+
+        std::atomic<size_t> nextChunk { 0 };
+        const auto renderChunks = [&] {
+            for (auto c = nextChunk++; c < chunks.size(); c = nextChunk++)
+            {
+                renderChunk (chunks[c], left, right, numSamples);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int t = 1; t < juce::jmin (numThreads, (int) chunks.size()); ++t)
+        {
+            workers.emplace_back (renderChunks);
+        }
+        renderChunks();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Chunks of the last render, for diagnostics
+    int getNumChunks() const { return numChunks; }
+
+private:
+    static constexpr int chunksPerThread = 4;
+
+    struct Chunk
+    {
+        int startBlock, endBlock;
+        ExpressionLanes expression;
+        typename VoiceBank<SampleType>::Checkpoint voices;
+    };
+
+    void collectBlockEvents (const juce::MidiMessageSequence& sequence, int numBlocks)
+    {
+        blockEvents.assign ((size_t) numBlocks + 1, 0);
+        events.clear();
+
+        for (const auto* holder : sequence)
+        {
+            const auto block = (int) (holder->message.getTimeStamp() / blockSize);
+            if (block >= 0 && block < numBlocks)
+            {
+                events.push_back ({ block, holder->message });
+            }
+        }
+        std::stable_sort (events.begin(), events.end(), [] (const auto& a, const auto& b) { return a.block < b.block; });
+
+        // blockEvents[b] is the index of the first event of block b
+        for (const auto& event : events)
+        {
+            ++blockEvents[(size_t) event.block + 1];
+        }
+        for (size_t b = 1; b < blockEvents.size(); ++b)
+        {
+            blockEvents[b] += blockEvents[b - 1];
+        }
+    }
+
+    // Control-only pass over the whole timeline, cutting at silent blocks at least minimumBlocks apart
+    std::vector<Chunk> findChunks (int numSamples, int minimumBlocks)
+    {
+        const auto numBlocks = (numSamples + blockSize - 1) / blockSize;
+        VoiceBank<SampleType> bank (carrier, accuracy);
+        bank.prepare (sampleRate, blockSize);
+        ExpressionLanes expression;
+
+        std::vector<Chunk> chunks;
+        chunks.push_back ({ 0, numBlocks, expression, {} });
+        bank.getCheckpoint (chunks.back().voices);
+        numChunks = 1;
+
+        if (minimumBlocks >= numBlocks)
+        {
+            return chunks;
+        }
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            if (block - chunks.back().startBlock >= minimumBlocks && bank.isSilent())
+            {
+                chunks.back().endBlock = block;
+                chunks.push_back ({ block, numBlocks, expression, {} });
+                bank.getCheckpoint (chunks.back().voices);
+            }
+
+            const auto length = getBlockLength (block, numSamples);
+            if (applyBlockEvents (block, length, bank, expression))
+            {
+                bank.updateControl (expression, length);
+            }
+        }
+
+        numChunks = (int) chunks.size();
+        return chunks;
+    }
+
+    void renderChunk (const Chunk& chunk, SampleType* left, SampleType* right, int numSamples)
+    {
+        VoiceBank<SampleType> bank (carrier, accuracy);
+        bank.prepare (sampleRate, blockSize);
+        bank.restoreCheckpoint (chunk.voices);
+        auto expression = chunk.expression;
+
+        for (int block = chunk.startBlock; block < chunk.endBlock; ++block)
+        {
+            const auto start = block * blockSize;
+            const auto length = getBlockLength (block, numSamples);
+
+            if (! applyBlockEvents (block, length, bank, expression))
+            {
+                juce::FloatVectorOperations::clear (left + start, length);
+                juce::FloatVectorOperations::clear (right + start, length);
+                continue;
+            }
+
+            bank.updateControl (expression, length);
+            bank.renderVoices (left + start, right + start, length);
+            if (! bank.isStereo())
+            {
+                juce::FloatVectorOperations::copy (right + start, left + start, length);
+            }
+        }
+    }
+
+    // The MIDI and expression part of AudioPluginAudioProcessor::render, returns false if the block is silent
+    bool applyBlockEvents (int block, int length, VoiceBank<SampleType>& bank, ExpressionLanes& expression) const
+    {
+        for (auto e = blockEvents[(size_t) block]; e < blockEvents[(size_t) block + 1]; ++e)
+        {
+            const auto& message = events[e].message;
+            expression.handleMidiMessage (message);
+
+            const auto expressionVoice = ExpressionLanes::getVoiceForChannel (message.getChannel());
+            if (message.isNoteOn())
+            {
+                bank.noteOn (message.getNoteNumber(), message.getFloatVelocity(), expressionVoice);
+            }
+            else if (message.isNoteOff())
+            {
+                bank.noteOff (message.getNoteNumber(), expressionVoice);
+            }
+            else if (message.isAllNotesOff() || message.isAllSoundOff())
+            {
+                bank.allNotesOff();
+            }
+        }
+
+        expression.advance ((double) length / sampleRate);
+        return bank.isActive();
+    }
+
+    int getBlockLength (int block, int numSamples) const { return juce::jmin (blockSize, numSamples - block * blockSize); }
+
+    struct Event
+    {
+        int block;
+        juce::MidiMessage message;
+    };
+
+    Signal<SampleType>& carrier;
+    fastmath::SineAccuracy accuracy;
+    double sampleRate;
+    int blockSize;
+
+    std::vector<Event> events;
+    std::vector<size_t> blockEvents;
+    int numChunks { 0 };
+};
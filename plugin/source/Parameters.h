@@ -0,0 +1,227 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+// Every plugin parameter in one compile-time table.
+//
+// Id indexes the table, and the Registry resolves each entry's APVTS value and parameter object once,
+// when the processor is built. DSP code then reads and writes parameters by index, so no ID string is
+// built, hashed or compared after construction. The string IDs remain for the host, the saved state
+// and the editor attachments. Table order is the host's parameter order: append new entries at the end.
+namespace params
+{
+    enum Id : int
+    {
+        None = -1,
+        MainEnabled,
+        MainAmplitude,
+        MainEnvelopeEnabled,
+        MainEnvelopeAttack,
+        MainEnvelopeDecay,
+        MainEnvelopeSustain,
+        MainEnvelopeRelease,
+        MainModEnabled,
+        MainModulationRatio,
+        MainModAmplitude,
+        MainUnisonVoices,
+        MainUnisonDetune,
+        MainUnisonSpread,
+        ResynthesisEnabled,
+        numParameters
+    };
+
+    enum class Kind
+    {
+        Bool,
+        Int,
+        Float
+    };
+
+    struct Spec
+    {
+        Id id;
+        const char* key;
+        const char* name;
+        Kind kind;
+        float minimum, maximum, defaultValue;
+    };
+
+    inline constexpr std::array<Spec, numParameters> specs { {
+        { MainEnabled, "main_enabled", "Main Sine Enabled", Kind::Bool, 0.0f, 1.0f, 1.0f },
+        { MainAmplitude, "main_amplitude", "Main Sine Amplitude", Kind::Float, 0.0f, 1.0f, 0.5f },
+        { MainEnvelopeEnabled, "main_envelope_enabled", "Envelope Enabled", Kind::Bool, 0.0f, 1.0f, 1.0f },
+        { MainEnvelopeAttack, "main_envelope_attack", "Envelope Attack", Kind::Float, 0.01f, 1.0f, 0.1f },
+        { MainEnvelopeDecay, "main_envelope_decay", "Envelope Decay", Kind::Float, 0.01f, 1.0f, 0.1f },
+        { MainEnvelopeSustain, "main_envelope_sustain", "Envelope Sustain", Kind::Float, 0.0f, 1.0f, 0.5f },
+        { MainEnvelopeRelease, "main_envelope_release", "Envelope Release", Kind::Float, 0.01f, 1.0f, 0.1f },
+        { MainModEnabled, "main_mod_enabled", "Modulation Enabled", Kind::Bool, 0.0f, 1.0f, 1.0f },
+        { MainModulationRatio, "main_modulation_ratio", "Modulation Ratio", Kind::Float, 0.01f, 10.0f, 0.5f },
+        { MainModAmplitude, "main_mod_amplitude", "Modulation Depth", Kind::Float, 0.0f, 10.0f, 0.5f },
+        { MainUnisonVoices, "main_unison_voices", "Unison Voices", Kind::Int, 1.0f, 8.0f, 1.0f },
+        { MainUnisonDetune, "main_unison_detune", "Unison Detune", Kind::Float, 0.0f, 50.0f, 10.0f },
+        { MainUnisonSpread, "main_unison_spread", "Unison Spread", Kind::Float, 0.0f, 1.0f, 0.5f },
+        { ResynthesisEnabled, "resynthesis_enabled", "Resynthesize Input", Kind::Bool, 0.0f, 1.0f, 0.0f },
+    } };
+
+    constexpr bool isInIdOrder()
+    {
+        for (size_t i = 0; i < specs.size(); ++i)
+            if (specs[i].id != (Id) i)
+                return false;
+        return true;
+    }
+
+    static_assert (isInIdOrder(), "specs must list the parameters in Id order");
+
+    constexpr const Spec& getSpec (Id id) { return specs[(size_t) id]; }
+
+    // Tag of the APVTS state, i.e. of the preset XML
+    inline constexpr const char* stateType = "Parameters";
+
+    // Float parameters snap to this step, like any host value the APVTS stores
+    inline constexpr float floatInterval = 0.01f;
+
+    // The plain value the APVTS ends up with when plainValue is set: clamped to the range, whole for
+    // Int and Bool, on floatInterval for Float
+    inline float toLegalValue (Id id, float plainValue)
+    {
+        const auto& spec = getSpec (id);
+        switch (spec.kind)
+        {
+            case Kind::Bool:
+                return plainValue >= 0.5f ? 1.0f : 0.0f;
+            case Kind::Int:
+                return (float) juce::jlimit ((int) spec.minimum, (int) spec.maximum, juce::roundToInt (plainValue));
+            case Kind::Float:
+                break;
+        }
+        const auto snapped = spec.minimum + floatInterval * std::floor ((plainValue - spec.minimum) / floatInterval + 0.5f);
+        return juce::jlimit (spec.minimum, spec.maximum, snapped);
+    }
+
+    // The parameters one operator (a Signal and its Envelope) reads, None where it has no such parameter
+    struct Operator
+    {
+        Id enabled, amplitude, modulationRatio;
+        Id envelopeEnabled, envelopeAttack, envelopeDecay, envelopeSustain, envelopeRelease;
+        Id unisonVoices, unisonDetune, unisonSpread;
+        const Operator* modulator;
+    };
+
+    inline constexpr Operator mainModulator { MainModEnabled, MainModAmplitude, None, None, None, None, None, None, None, None, None, nullptr };
+
+    inline constexpr Operator mainCarrier { MainEnabled,
+                                            MainAmplitude,
+                                            MainModulationRatio,
+                                            MainEnvelopeEnabled,
+                                            MainEnvelopeAttack,
+                                            MainEnvelopeDecay,
+                                            MainEnvelopeSustain,
+                                            MainEnvelopeRelease,
+                                            MainUnisonVoices,
+                                            MainUnisonDetune,
+                                            MainUnisonSpread,
+                                            &mainModulator };
+
+    inline juce::AudioProcessorValueTreeState::ParameterLayout createLayout()
+    {
+        juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+        for (const auto& spec : specs)
+        {
+            const juce::ParameterID parameterID { spec.key, 1 };
+            switch (spec.kind)
+            {
+                case Kind::Bool:
+                    layout.add (std::make_unique<juce::AudioParameterBool> (parameterID, spec.name, spec.defaultValue > 0.5f));
+                    break;
+                case Kind::Int:
+                    layout.add (std::make_unique<juce::AudioParameterInt> (parameterID,
+                                                                           spec.name,
+                                                                           (int) spec.minimum,
+                                                                           (int) spec.maximum,
+                                                                           (int) spec.defaultValue));
+                    break;
+                case Kind::Float:
+                    layout.add (std::make_unique<juce::AudioParameterFloat> (parameterID,
+                                                                             spec.name,
+                                                                             juce::NormalisableRange<float> (spec.minimum,
+                                                                                                             spec.maximum,
+                                                                                                             floatInterval),
+                                                                             spec.defaultValue));
+                    break;
+            }
+        }
+        return layout;
+    }
+
+    // Value pointers and parameter objects of one APVTS, indexed by Id
+    class Registry
+    {
+    public:
+        explicit Registry (juce::AudioProcessorValueTreeState& apvts) : state (&apvts)
+        {
+            for (const auto& spec : specs)
+            {
+                values[(size_t) spec.id] = state->getRawParameterValue (spec.key);
+                parameters[(size_t) spec.id] = state->getParameter (spec.key);
+                jassert (values[(size_t) spec.id] != nullptr && parameters[(size_t) spec.id] != nullptr);
+            }
+        }
+
+        // Without an APVTS: the values live in storage and there are no parameter objects or listeners.
+        // Code that renders presets outside a plugin instance (timbre::PresetRenderer) reads it like any other.
+        explicit Registry (std::array<std::atomic<float>, numParameters>& storage)
+        {
+            for (const auto& spec : specs)
+                values[(size_t) spec.id] = &storage[(size_t) spec.id];
+        }
+
+        // Plain (denormalised) value, updated by the host on any thread. Null for None.
+        std::atomic<float>* getRawValue (Id id) const { return id == None ? nullptr : values[(size_t) id]; }
+
+        float get (Id id) const { return getRawValue (id)->load(); }
+
+        // Only for a registry of an APVTS
+        juce::RangedAudioParameter& getParameter (Id id) const
+        {
+            jassert (parameters[(size_t) id] != nullptr);
+            return *parameters[(size_t) id];
+        }
+
+        // Sets a plain value as a single gesture, notifying the host
+        void set (Id id, float plainValue) const
+        {
+            if (state == nullptr)
+            {
+                values[(size_t) id]->store (toLegalValue (id, plainValue));
+                return;
+            }
+
+            auto& parameter = getParameter (id);
+            parameter.beginChangeGesture();
+            parameter.setValueNotifyingHost (parameter.convertTo0to1 (plainValue));
+            parameter.endChangeGesture();
+        }
+
+        void addListener (Id id, juce::AudioProcessorValueTreeState::Listener* listener) const
+        {
+            jassert (state != nullptr);
+            state->addParameterListener (getSpec (id).key, listener);
+        }
+
+        void removeListener (Id id, juce::AudioProcessorValueTreeState::Listener* listener) const
+        {
+            jassert (state != nullptr);
+            state->removeParameterListener (getSpec (id).key, listener);
+        }
+
+    private:
+        juce::AudioProcessorValueTreeState* state = nullptr;
+        std::array<std::atomic<float>*, numParameters> values {};
+        std::array<juce::RangedAudioParameter*, numParameters> parameters {};
+    };
+} // namespace params
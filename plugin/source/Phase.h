@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Fixed-point oscillator phase.
+//
+// One full cycle maps onto the whole 32 bit range, so adding the increment wraps around for free
+// and the phase never loses precision however long a note rings. At 48 kHz the frequency
+// resolution is 48000 / 2^32, about 1e-5 Hz.
+//
+// Conversions reinterpret the phase as signed, giving [-0.5, 0.5) cycles. Periodic functions do not
+// care about the offset, and int32 to float/double is a single vector instruction on every target
+// (unsigned conversion is not).
+namespace phase
+{
+    using Accumulator = std::uint32_t;
+
+    constexpr double unitsPerCycle = 4294967296.0;
+
+    inline Accumulator fromCycles (double cycles)
+    {
+        const auto wrapped = cycles - std::floor (cycles);
+        return (Accumulator) (std::uint64_t) std::llround (wrapped * unitsPerCycle);
+    }
+
+    inline Accumulator incrementForFrequency (double frequency, double sampleRate) { return fromCycles (frequency / sampleRate); }
+
+    template <typename T>
+    inline T toCycles (Accumulator phase)
+    {
+        static_assert (std::is_floating_point_v<T>);
+        return (T) (std::int32_t) phase * (T) (1.0 / unitsPerCycle);
+    }
+
+    template <typename T>
+    inline T toRadians (Accumulator phase)
+    {
+        static_assert (std::is_floating_point_v<T>);
+        return (T) (std::int32_t) phase * (T) (6.283185307179586476925 / unitsPerCycle);
+    }
+} // namespace phase
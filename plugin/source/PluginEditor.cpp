@@ -10,7 +10,7 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (600, 500);
+    setSize (600, 760);
 
     // ============================================================================================
     // ENABLE SIGNAL BUTTON
@@ -23,6 +23,14 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
                                                                                                      "main_enabled",
                                                                                                      enableSignalButton);
     // ============================================================================================
+    // RESYNTHESIS BUTTON
+
+    addAndMakeVisible (resynthesisButton);
+    resynthesisButton.setButtonText ("Resynthesize Input");
+    resynthesisAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment> (apvts,
+                                                                                                    "resynthesis_enabled",
+                                                                                                    resynthesisButton);
+    // ============================================================================================
     // AMPLITUDE SLIDER
 
     addAndMakeVisible (amplitudeLabel);
@@ -128,6 +136,46 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
                                                                                                         "main_mod_amplitude",
                                                                                                         modulationDepthSlider);
 
+    // ============================================================================================
+    // UNISON VOICES SLIDER
+
+    addAndMakeVisible (unisonVoicesLabel);
+    unisonVoicesLabel.setText ("Unison", juce::dontSendNotification);
+    auto& unisonVoicesParam = *apvts.getRawParameterValue ("main_unison_voices");
+    auto unisonVoicesParamRange = apvts.getParameterRange ("main_unison_voices");
+    addAndMakeVisible (unisonVoicesSlider);
+    unisonVoicesSlider.setRange (unisonVoicesParamRange.start, unisonVoicesParamRange.end, 1.0);
+    unisonVoicesSlider.setValue (unisonVoicesParam.load());
+    unisonVoicesAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (apvts,
+                                                                                                     "main_unison_voices",
+                                                                                                     unisonVoicesSlider);
+    // ============================================================================================
+    // UNISON DETUNE SLIDER
+
+    addAndMakeVisible (unisonDetuneLabel);
+    unisonDetuneLabel.setText ("Detune", juce::dontSendNotification);
+    auto& unisonDetuneParam = *apvts.getRawParameterValue ("main_unison_detune");
+    auto unisonDetuneParamRange = apvts.getParameterRange ("main_unison_detune");
+    addAndMakeVisible (unisonDetuneSlider);
+    unisonDetuneSlider.setRange (unisonDetuneParamRange.start, unisonDetuneParamRange.end, 0.1);
+    unisonDetuneSlider.setValue (unisonDetuneParam.load());
+    unisonDetuneAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (apvts,
+                                                                                                     "main_unison_detune",
+                                                                                                     unisonDetuneSlider);
+    // ============================================================================================
+    // UNISON SPREAD SLIDER
+
+    addAndMakeVisible (unisonSpreadLabel);
+    unisonSpreadLabel.setText ("Spread", juce::dontSendNotification);
+    auto& unisonSpreadParam = *apvts.getRawParameterValue ("main_unison_spread");
+    auto unisonSpreadParamRange = apvts.getParameterRange ("main_unison_spread");
+    addAndMakeVisible (unisonSpreadSlider);
+    unisonSpreadSlider.setRange (unisonSpreadParamRange.start, unisonSpreadParamRange.end, 0.01);
+    unisonSpreadSlider.setValue (unisonSpreadParam.load());
+    unisonSpreadAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (apvts,
+                                                                                                     "main_unison_spread",
+                                                                                                     unisonSpreadSlider);
+
     // ============================================================================================
     // MODULATION SUPERKNOB
     addAndMakeVisible (modulationSuperKnobLabel);
@@ -135,10 +183,68 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     addAndMakeVisible (modulationSuperKnobSlider);
     modulationSuperKnobSlider.setRange (0.001, 10.0, 0.01);
     modulationSuperKnobSlider.setValue (5);
+
+    // ============================================================================================
+    // CPU LOAD
+    addAndMakeVisible (telemetryLabel);
+    telemetryLabel.setFont (juce::Font (juce::FontOptions (13.0f)));
+    startTimerHz (4);
+
+    // ============================================================================================
+    // SIMILAR PRESETS
+    addAndMakeVisible (findSimilarButton);
+    findSimilarButton.setButtonText ("Find Similar Presets");
+    findSimilarButton.onClick = [this] { findSimilarPresets(); };
+    addAndMakeVisible (similarPresetsLabel);
+    similarPresetsLabel.setFont (juce::Font (juce::FontOptions (13.0f)));
+    similarPresetsLabel.setJustificationType (juce::Justification::topLeft);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor() {}
 
+void AudioPluginAudioProcessorEditor::timerCallback()
+{
+    // Loads are fractions of the callback deadline (numSamples / sampleRate)
+    const auto snapshot = processorRef.getTelemetry().getSnapshot();
+    const auto& total = snapshot[Telemetry::Stage::Total];
+    const auto percent = [] (double load) { return juce::String (load * 100.0, 1) + "%"; };
+
+    telemetryLabel.setText ("CPU p50 " + percent (total.p50) + "  p99 " + percent (total.p99) + "  max " + percent (total.max)
+                                + "  overruns " + juce::String ((juce::int64) snapshot.numOverruns) + "  |  osc p99 "
+                                + percent (snapshot[Telemetry::Stage::Oscillators].p99) + "  env p99 "
+                                + percent (snapshot[Telemetry::Stage::Envelope].p99),
+                            juce::dontSendNotification);
+}
+
+void AudioPluginAudioProcessorEditor::findSimilarPresets()
+{
+    findSimilarButton.setEnabled (false);
+    similarPresetsLabel.setText ("Searching...", juce::dontSendNotification);
+
+    // The editor can be closed before the result arrives
+    processorRef.findSimilarPresets (5, [editor = juce::Component::SafePointer<AudioPluginAudioProcessorEditor> (this)] (const auto& matches) {
+        if (editor != nullptr)
+            editor->showSimilarPresets (matches);
+    });
+}
+
+void AudioPluginAudioProcessorEditor::showSimilarPresets (const std::vector<timbre::Index::Match>& matches)
+{
+    findSimilarButton.setEnabled (true);
+    if (matches.empty())
+    {
+        similarPresetsLabel.setText ("No timbre index at " + timbre::Index::getDefaultFile().getFullPathName()
+                                         + ", build one with TimbreIndexer",
+                                     juce::dontSendNotification);
+        return;
+    }
+
+    juce::StringArray lines;
+    for (const auto& match : matches)
+        lines.add (match.name + "  (" + juce::String (match.similarity, 3) + ")");
+    similarPresetsLabel.setText (lines.joinIntoString ("\n"), juce::dontSendNotification);
+}
+
 //==============================================================================
 void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
 {
@@ -161,6 +267,7 @@ void AudioPluginAudioProcessorEditor::resized()
     const auto sliderWidth = getWidth() - sliderX - 20;
 
     enableSignalButton.setBounds (labelX, labelY, 150, height);
+    resynthesisButton.setBounds (labelX + 160, labelY, 180, height);
     labelY += 40;
 
     amplitudeLabel.setBounds (labelX, labelY, labelWidth, height);
@@ -195,8 +302,27 @@ void AudioPluginAudioProcessorEditor::resized()
 
     modulationDepthLabel.setBounds (labelX, labelY, labelWidth, height);
     modulationDepthSlider.setBounds (sliderX, labelY, sliderWidth, height);
+    labelY += 60;
+
+    unisonVoicesLabel.setBounds (labelX, labelY, labelWidth, height);
+    unisonVoicesSlider.setBounds (sliderX, labelY, sliderWidth, height);
+    labelY += 40;
+
+    unisonDetuneLabel.setBounds (labelX, labelY, labelWidth, height);
+    unisonDetuneSlider.setBounds (sliderX, labelY, sliderWidth, height);
+    labelY += 40;
+
+    unisonSpreadLabel.setBounds (labelX, labelY, labelWidth, height);
+    unisonSpreadSlider.setBounds (sliderX, labelY, sliderWidth, height);
     labelY += 40;
 
     modulationSuperKnobLabel.setBounds (labelX, labelY, labelWidth, height);
     modulationSuperKnobSlider.setBounds (sliderX, labelY, sliderWidth, height);
+    labelY += 50;
+
+    telemetryLabel.setBounds (labelX, labelY, getWidth() - 2 * labelX, 30);
+    labelY += 40;
+
+    findSimilarButton.setBounds (labelX, labelY, 150, 30);
+    similarPresetsLabel.setBounds (sliderX + 60, labelY, getWidth() - sliderX - 80, 70);
 }
@@ -5,7 +5,7 @@
 #include <JuceHeader.h>
 
 //==============================================================================
-class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor
+class AudioPluginAudioProcessorEditor : public juce::AudioProcessorEditor, private juce::Timer
 {
 public:
     explicit AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor&);
@@ -16,6 +16,10 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+    void findSimilarPresets();
+    void showSimilarPresets (const std::vector<timbre::Index::Match>& matches);
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     AudioPluginAudioProcessor& processorRef;
@@ -25,6 +29,9 @@ private:
     juce::ToggleButton enableSignalButton;
     std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> enableSignalAttachment;
 
+    juce::ToggleButton resynthesisButton;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> resynthesisAttachment;
+
     juce::Label amplitudeLabel;
     juce::Slider amplitudeSlider;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> amplitudeAttachment;
@@ -59,8 +66,25 @@ private:
     juce::Slider modulationDepthSlider;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> modulationDepthAttachment;
 
+    juce::Label unisonVoicesLabel;
+    juce::Slider unisonVoicesSlider;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> unisonVoicesAttachment;
+
+    juce::Label unisonDetuneLabel;
+    juce::Slider unisonDetuneSlider;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> unisonDetuneAttachment;
+
+    juce::Label unisonSpreadLabel;
+    juce::Slider unisonSpreadSlider;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> unisonSpreadAttachment;
+
     juce::Label modulationSuperKnobLabel;
     SuperSlider modulationSuperKnobSlider;
 
+    juce::Label telemetryLabel;
+
+    juce::TextButton findSimilarButton;
+    juce::Label similarPresetsLabel;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
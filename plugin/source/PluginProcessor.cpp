@@ -15,20 +15,42 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                           .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
 #endif
                           )
-    , notePlaying (-1)
+    , maximumBlockSize (0)
     , mainSine (nullptr)
-    , apvts (*this, nullptr, juce::Identifier ("Parameters"), createParameterLayout())
+    , mainSineDouble (nullptr)
+    , voices (nullptr)
+    , voicesDouble (nullptr)
+    , apvts (*this, nullptr, juce::Identifier (params::stateType), params::createLayout())
+    , parameters (apvts)
 {
+    mainSine = std::make_unique<Signal<float>> (params::mainCarrier, parameters);
+    mainSine->enableModulation();
+    mainSineDouble = std::make_unique<Signal<double>> (params::mainCarrier, parameters);
+    mainSineDouble->enableModulation();
+
+    // Carrier and modulator of a voice share one tier, the kernel evaluates both in the same loop.
+    // Offline/mastering renders get the near-exact sine.
+    voices = std::make_unique<VoiceBank<float>> (*mainSine, fastmath::SineAccuracy::Precise);
+    voicesDouble = std::make_unique<VoiceBank<double>> (*mainSineDouble, fastmath::SineAccuracy::Exact);
+
+    parameters.addListener (params::ResynthesisEnabled, this);
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
-    // Ensure that the mainSine is properly cleaned up
+    parameters.removeListener (params::ResynthesisEnabled, this);
+    cancelPendingUpdate();
+
+    // Ensure that the mainSine is properly cleaned up, the voice banks refer to the signals
+    voices.reset();
+    voicesDouble.reset();
     if (mainSine)
     {
         mainSine->setEnabled (false);
         mainSine.reset();
     }
+    mainSineDouble.reset();
+    dumpTelemetry();
 }
 
 //==============================================================================
@@ -66,7 +88,10 @@ bool AudioPluginAudioProcessor::isMidiEffect() const
 
 double AudioPluginAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    if (parameters.get (params::MainEnvelopeEnabled) < 0.5f)
+        return 0.0;
+
+    return Envelope<float>::getReleaseTailSeconds (parameters.get (params::MainEnvelopeRelease));
 }
 
 int AudioPluginAudioProcessor::getNumPrograms()
@@ -99,17 +124,53 @@ void AudioPluginAudioProcessor::changeProgramName (int index, const juce::String
 //==============================================================================
 void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
-    juce::ignoreUnused (sampleRate, samplesPerBlock);
-    mainSine = std::make_unique<Signal> (generateSine, sampleRate, "main", apvts);
-    mainSine->enableModulation (generateSine);
+    // Hosts call this on every sample rate or block size change, and some on every transport start.
+    // The DSP graph already exists, so this only retunes it and resizes scratch memory.
+    maximumBlockSize = samplesPerBlock;
+    telemetry.prepare (sampleRate);
+    resynthesizer.prepare (sampleRate);
+    resynthesisPrepared = true;
+    updateResynthesisThread();
+    if (isUsingDoublePrecision())
+        voicesDouble->prepare (sampleRate, samplesPerBlock);
+    else
+        voices->prepare (sampleRate, samplesPerBlock);
 }
 
 void AudioPluginAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    resynthesisPrepared = false;
+    resynthesizer.release();
+    dumpTelemetry();
+}
+
+void AudioPluginAudioProcessor::parameterChanged (const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused (parameterID, newValue);
+    if (juce::MessageManager::existsAndIsCurrentThread())
+        updateResynthesisThread();
+    else
+        triggerAsyncUpdate();
+}
+
+void AudioPluginAudioProcessor::handleAsyncUpdate()
+{
+    updateResynthesisThread();
+}
+
+void AudioPluginAudioProcessor::updateResynthesisThread()
+{
+    resynthesizer.setRunning (resynthesisPrepared && parameters.get (params::ResynthesisEnabled) >= 0.5f);
+}
+
+void AudioPluginAudioProcessor::dumpTelemetry() const
+{
+    // Headless instances (render farms, CI) are monitored through this file rather than the editor
+    const auto path = juce::SystemStats::getEnvironmentVariable ("FMSYNTH_TELEMETRY_FILE", {});
+    if (path.isNotEmpty() && juce::File::isAbsolutePath (path))
+        juce::File (path).replaceWithText (telemetry.toJSON());
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -136,23 +197,69 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 #endif
 }
 
+bool AudioPluginAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    for (const auto messageData : midiMessages)
+    render (buffer, midiMessages, *voices);
+}
+
+void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    render (buffer, midiMessages, *voicesDouble);
+}
+
+template <typename SampleType>
+void AudioPluginAudioProcessor::render (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages, VoiceBank<SampleType>& bank)
+{
+    Telemetry::ScopedBlock scopedBlock (telemetry, buffer.getNumSamples());
+
+    // Some hosts render before prepareToPlay, or without preparing the chain of the current precision.
+    // The bank has no tables or scratch memory then, so MIDI is dropped rather than starting notes.
+    if (maximumBlockSize <= 0 || ! bank.isPrepared())
+    {
+        buffer.clear();
+        return;
+    }
+
     {
-        const auto message = messageData.getMessage();
-        if (message.isNoteOn() && notePlaying < 0)
+        Telemetry::ScopedStage stage (telemetry, Telemetry::Stage::Midi);
+        for (const auto messageData : midiMessages)
         {
-            notePlaying = message.getNoteNumber();
-            const auto newFrequency = juce::MidiMessage::getMidiNoteInHertz (notePlaying);
-            mainSine->updateFrequency (newFrequency);
+            handleMidiMessage (messageData.getMessage(), bank);
         }
-        else if (message.isNoteOff() && notePlaying == message.getNoteNumber())
+
+        // The input is queued before the buffer is overwritten with the render
+        if (parameters.get (params::ResynthesisEnabled) >= 0.5f)
+        {
+            resynthesizer.pushInput (buffer, getTotalNumInputChannels());
+            followResynthesis (resynthesizer.getLatestPatch(), bank);
+        }
+        else if (resynthesisActive)
+        {
+            followResynthesis ({}, bank);
+            bank.setPatchOverride (std::nullopt);
+            resynthesisActive = false;
+        }
+
+        // Control rate: the lanes are smoothed once per block, the voices ramp across it
+        if (getSampleRate() > 0.0)
         {
-            notePlaying = -1;
+            expression.advance ((double) buffer.getNumSamples() / getSampleRate());
         }
     }
 
+    // Idle path: one clear instead of running the oscillators and envelope to produce zeros.
+    // clear() also flags the buffer as silent (hasBeenCleared), which is what the wrappers can report to the host.
+    if (! bank.isActive())
+    {
+        buffer.clear();
+        return;
+    }
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -162,17 +269,96 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
         buffer.clear (i, 0, buffer.getNumSamples());
     }
 
-    for (unsigned long channel = 0; channel < (unsigned long) totalNumOutputChannels; ++channel)
+    // Voices are rendered once: straight into left and right when unison pans them, otherwise into the
+    // first channel and copied, since every channel would get the same signal
+    const auto numSamples = buffer.getNumSamples();
+    auto* left = buffer.getWritePointer (0);
+    auto* right = totalNumOutputChannels > 1 ? buffer.getWritePointer (1) : nullptr;
+
+    // Some hosts occasionally send more samples than announced in prepareToPlay
+    for (int start = 0; start < numSamples; start += maximumBlockSize)
     {
-        auto* channelData = buffer.getWritePointer ((int) channel);
-        auto numSamples = buffer.getNumSamples();
-        for (int sample = 0; sample < numSamples; ++sample)
+        const auto numChunkSamples = juce::jmin (maximumBlockSize, numSamples - start);
+        {
+            Telemetry::ScopedStage stage (telemetry, Telemetry::Stage::Envelope);
+            bank.updateControl (expression, numChunkSamples);
+        }
         {
-            channelData[sample] = (float) (mainSine->getSample (channel, notePlaying >= 0));
+            Telemetry::ScopedStage stage (telemetry, Telemetry::Stage::Oscillators);
+            bank.renderVoices (left + start, right != nullptr ? right + start : nullptr, numChunkSamples);
+        }
+        if (right != nullptr && ! bank.isStereo())
+        {
+            juce::FloatVectorOperations::copy (right + start, left + start, numChunkSamples);
         }
     }
 }
 
+template <typename SampleType>
+void AudioPluginAudioProcessor::handleMidiMessage (const juce::MidiMessage& message, VoiceBank<SampleType>& bank)
+{
+    expression.handleMidiMessage (message);
+
+    const auto expressionVoice = ExpressionLanes::getVoiceForChannel (message.getChannel());
+    if (message.isNoteOn())
+    {
+        bank.noteOn (message.getNoteNumber(), message.getFloatVelocity(), expressionVoice);
+    }
+    else if (message.isNoteOff())
+    {
+        bank.noteOff (message.getNoteNumber(), expressionVoice);
+    }
+    else if (message.isAllNotesOff() || message.isAllSoundOff())
+    {
+        bank.allNotesOff();
+    }
+}
+
+template <typename SampleType>
+void AudioPluginAudioProcessor::followResynthesis (const resynthesis::Patch& patch, VoiceBank<SampleType>& bank)
+{
+    // Jumps larger than this start a new note, smaller ones glide like a bend
+    constexpr double retriggerSemitones = 1.0;
+
+    // No MIDI channel maps to this voice, so played notes never pick up the tracked patch or pitch
+    constexpr auto voice = ExpressionLanes::internalVoice;
+
+    if (! patch.voiced)
+    {
+        if (resynthesisNote >= 0)
+        {
+            bank.noteOff (resynthesisNote, voice);
+            resynthesisNote = -1;
+        }
+        return;
+    }
+
+    // The tracked pitch is a note plus a bend on its expression voice, like a played MPE note
+    const auto semitones = 69.0 + 12.0 * std::log2 ((double) patch.frequency / DspResourceCache::defaultTuningFrequency);
+    const auto startNote = resynthesisNote < 0 || std::abs (semitones - resynthesisNote) > retriggerSemitones;
+    if (startNote && resynthesisNote >= 0)
+    {
+        bank.noteOff (resynthesisNote, voice);
+    }
+    if (startNote)
+    {
+        resynthesisNote = juce::jlimit (0, DspResources::numMidiNotes - 1, (int) std::lround (semitones));
+    }
+
+    expression.setTarget (ExpressionLanes::Pitch, voice, (float) (semitones - resynthesisNote));
+    if (startNote)
+    {
+        expression.noteOn (voice, 1.0f);
+        bank.noteOn (resynthesisNote, 1.0f, voice);
+    }
+
+    bank.setPatchOverride (typename VoiceBank<SampleType>::PatchOverride { (SampleType) patch.level,
+                                                                          (SampleType) patch.modulationAmplitude,
+                                                                          (double) patch.modulationRatio,
+                                                                          voice });
+    resynthesisActive = true;
+}
+
 //==============================================================================
 bool AudioPluginAudioProcessor::hasEditor() const
 {
@@ -187,17 +373,57 @@ juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor()
 //==============================================================================
 void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    juce::ignoreUnused (destData);
+    // The parameter tree as XML, which is also the preset file format
+    if (const auto xml = apvts.copyState().createXml())
+    {
+        copyXmlToBinary (*xml, destData);
+    }
 }
 
 void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
-    juce::ignoreUnused (data, sizeInBytes);
+    const auto xml = getXmlFromBinary (data, sizeInBytes);
+    if (xml != nullptr && xml->hasTagName (apvts.state.getType()))
+    {
+        apvts.replaceState (juce::ValueTree::fromXml (*xml));
+    }
+}
+
+void AudioPluginAudioProcessor::findSimilarPresets (int numResults, SimilarPresetsCallback onResult)
+{
+    // The value tree belongs to the message thread, so the state is copied before leaving it
+    std::shared_ptr<const juce::XmlElement> state = apvts.copyState().createXml();
+    if (state == nullptr)
+    {
+        onResult ({});
+        return;
+    }
+
+    similarPresetsPool.addJob ([this, state, numResults, onResult = std::move (onResult)] {
+        auto matches = querySimilarPresets (*state, numResults);
+        juce::MessageManager::callAsync ([onResult, matches = std::move (matches)] { onResult (matches); });
+    });
+}
+
+std::vector<timbre::Index::Match> AudioPluginAudioProcessor::querySimilarPresets (const juce::XmlElement& state, int numResults)
+{
+    if (presetRenderer == nullptr)
+    {
+        presetRenderer = std::make_unique<timbre::PresetRenderer>();
+    }
+
+    if (timbreIndex == nullptr)
+    {
+        auto index = std::make_unique<timbre::Index>();
+        if (! index->load (timbre::Index::getDefaultFile()))
+        {
+            return {};
+        }
+        timbreIndex = std::move (index);
+    }
+
+    const auto embedding = timbre::computeEmbeddings ({ presetRenderer->render (state) });
+    return timbreIndex->query (embedding.data(), numResults);
 }
 
 //==============================================================================
@@ -206,51 +432,3 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
     return new AudioPluginAudioProcessor();
 }
-
-juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::createParameterLayout()
-{
-    juce::AudioProcessorValueTreeState::ParameterLayout layout;
-
-    layout.add (std::make_unique<juce::AudioParameterBool> (juce::ParameterID { "main_enabled", 1 }, "Main Sine Enabled", true));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_amplitude", 1 },
-                                                             "Main Sine Amplitude",
-                                                             0.0f,
-                                                             1.0f,
-                                                             0.5f));
-
-    layout.add (std::make_unique<juce::AudioParameterBool> (juce::ParameterID { "main_envelope_enabled", 1 }, "Envelope Enabled", true));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_envelope_attack", 1 },
-                                                             "Envelope Attack",
-                                                             0.01f,
-                                                             1.0f,
-                                                             0.1f));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_envelope_decay", 1 },
-                                                             "Envelope Decay",
-                                                             0.01f,
-                                                             1.0f,
-                                                             0.1f));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_envelope_sustain", 1 },
-                                                             "Envelope Sustain",
-                                                             0.0f,
-                                                             1.0f,
-                                                             0.5f));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_envelope_release", 1 },
-                                                             "Envelope Release",
-                                                             0.01f,
-                                                             1.0f,
-                                                             0.1f));
-
-    layout.add (std::make_unique<juce::AudioParameterBool> (juce::ParameterID { "main_mod_enabled", 1 }, "Modulation Enabled", true));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_modulation_ratio", 1 },
-                                                             "Modulation Ratio",
-                                                             0.01f,
-                                                             10.0f,
-                                                             0.5f));
-    layout.add (std::make_unique<juce::AudioParameterFloat> (juce::ParameterID { "main_mod_amplitude", 1 },
-                                                             "Modulation Depth",
-                                                             0.0f,
-                                                             10.0f,
-                                                             0.5f));
-
-    return layout;
-}
@@ -1,12 +1,20 @@
 #pragma once
 
+#include "Expression.h"
+#include "Parameters.h"
+#include "Resynthesis.h"
 #include "SynthSignal.h"
+#include "Telemetry.h"
+#include "TimbreIndex.h"
+#include "VoiceBank.h"
 #include <JuceHeader.h>
 #include <cmath>
 #include <juce_audio_processors/juce_audio_processors.h>
 
 //==============================================================================
-class AudioPluginAudioProcessor : public juce::AudioProcessor
+class AudioPluginAudioProcessor : public juce::AudioProcessor,
+                                  private juce::AudioProcessorValueTreeState::Listener,
+                                  private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -20,8 +28,11 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
     using AudioProcessor::processBlock;
 
+    bool supportsDoublePrecisionProcessing() const override;
+
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -45,7 +56,10 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    Signal& getMainSine() { return *mainSine; }
+    Signal<float>& getMainSine() { return *mainSine; }
+    Signal<double>& getMainSineDouble() { return *mainSineDouble; }
+    VoiceBank<float>& getVoices() { return *voices; }
+    VoiceBank<double>& getVoicesDouble() { return *voicesDouble; }
 
     juce::AudioParameterFloat* amplitudeParam;
     juce::AudioParameterFloat* attackParam;
@@ -60,18 +74,77 @@ public:
     juce::AudioParameterBool* enableModulationParam;
 
     juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
+    const params::Registry& getParameters() const { return parameters; }
+
+    using SimilarPresetsCallback = std::function<void (const std::vector<timbre::Index::Match>&)>;
+
+    // Presets of the library whose timbre is closest to the current patch, best first, empty without an
+    // index. Rendering the patch (and loading the index on first use) takes a while, so it runs on a
+    // background thread; onResult is called on the message thread. Call from the message thread.
+    void findSimilarPresets (int numResults, SimilarPresetsCallback onResult);
+
+    // Analysis side of the resynthesis mode (resynthesis_enabled), for diagnostics
+    const resynthesis::Resynthesizer& getResynthesizer() const { return resynthesizer; }
+
+    // Callback timing, safe to read from any thread
+    const Telemetry& getTelemetry() const { return telemetry; }
+    Telemetry& getTelemetry() { return telemetry; }
 
 private:
-    int notePlaying;
+    int maximumBlockSize;
+
+    void dumpTelemetry() const;
+
+    template <typename SampleType>
+    void render (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages, VoiceBank<SampleType>& bank);
+
+    template <typename SampleType>
+    void handleMidiMessage (const juce::MidiMessage& message, VoiceBank<SampleType>& bank);
 
-    static double generateSine (double phase) { return std::sin (phase); }
+    // Plays the latest resynthesis patch as a note on ExpressionLanes::internalVoice, or releases it
+    template <typename SampleType>
+    void followResynthesis (const resynthesis::Patch& patch, VoiceBank<SampleType>& bank);
 
-    std::unique_ptr<Signal> mainSine;
+    // The analysis thread runs while resynthesis_enabled is on and the processor is prepared. Parameter
+    // changes can arrive on any thread, starting and stopping the thread is left to the message thread.
+    void parameterChanged (const juce::String& parameterID, float newValue) override;
+    void handleAsyncUpdate() override;
+    void updateResynthesisThread();
 
-    juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+    // Background side of findSimilarPresets(), only ever runs on similarPresetsPool
+    std::vector<timbre::Index::Match> querySimilarPresets (const juce::XmlElement& state, int numResults);
+
+    // Float is the default render path, the double chain serves hosts that ask for double precision.
+    // Both are built once in the constructor; prepareToPlay only resizes and retunes them.
+    // The signals hold the operator parameters, the voice banks the per-note state and rendering.
+    std::unique_ptr<Signal<float>> mainSine;
+    std::unique_ptr<Signal<double>> mainSineDouble;
+    std::unique_ptr<VoiceBank<float>> voices;
+    std::unique_ptr<VoiceBank<double>> voicesDouble;
 
     juce::AudioProcessorValueTreeState apvts;
 
+    // Resolved once from apvts, everything after construction reads parameters through it
+    params::Registry parameters;
+
+    // Per-note pitch/pressure/timbre by MIDI channel, each voice follows the lanes of its note's channel
+    ExpressionLanes expression;
+
+    Telemetry telemetry;
+
+    // The input is analysed off the audio thread, the tracked note is played on an expression voice of its own
+    resynthesis::Resynthesizer resynthesizer;
+    bool resynthesisPrepared = false;
+    int resynthesisNote = -1;
+    bool resynthesisActive = false;
+
+    std::unique_ptr<timbre::Index> timbreIndex;
+    std::unique_ptr<timbre::PresetRenderer> presetRenderer;
+
+    // One thread, so queries never overlap. Declared last: it waits for a running query before the
+    // members that query uses are destroyed.
+    juce::ThreadPool similarPresetsPool { 1 };
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
 };
@@ -0,0 +1,466 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Audio-to-patch resynthesis: the plugin's input is analysed into an FM patch that the voice bank plays.
+//
+// The audio thread only downmixes its input into a lock-free ring buffer (juce::AbstractFifo) and picks
+// up the most recent patch from an AtomicDoubleBuffer; neither blocks, allocates or does more than a
+// copy. A background thread, running only while the mode is on, drains the ring buffer, and every
+// hopSize samples analyses the newest frameSize samples: YIN pitch detection, the amplitudes of the
+// first harmonics, and a fit of those against a table of FM spectra (carrier harmonic, modulation ratio
+// and index), built from the Bessel functions when the first analysis thread of the process starts and
+// shared by every instance. Only the newest frame is analysed when the thread falls behind, and the ring
+// buffer drops input rather than grow, so the patch is never more than a frame and a hop behind the input.
+namespace resynthesis
+{
+    // Hands the most recent value from one writer thread to one reader thread.
+    //
+    // The writer fills the slot the reader is not pointed at and then flips the published index. The
+    // reader sets a busy flag for the length of its copy, and the writer does not flip while the flag
+    // is set, so the reader's slot is never written under it. The reader never waits; the writer waits
+    // at most for one copy.
+    template <typename Value>
+    class AtomicDoubleBuffer
+    {
+    public:
+        // Writer thread only
+        void publish (const Value& value)
+        {
+            auto expected = state.load (std::memory_order_relaxed) & publishedBit;
+            slots[(size_t) (expected ^ publishedBit)] = value;
+
+            while (! state.compare_exchange_weak (expected, expected ^ publishedBit, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                expected &= publishedBit;
+                std::this_thread::yield();
+            }
+        }
+
+        // Reader thread only, wait-free
+        Value read() const
+        {
+            const auto published = state.fetch_or (busyBit, std::memory_order_acquire) & publishedBit;
+            const auto value = slots[(size_t) published];
+            state.fetch_and (~busyBit, std::memory_order_release);
+            return value;
+        }
+
+    private:
+        static constexpr int publishedBit = 1;
+        static constexpr int busyBit = 2;
+
+        std::array<Value, 2> slots {};
+        mutable std::atomic<int> state { 0 };
+    };
+
+    // What the voice bank plays: one note and the FM parameters, in the units of the plugin parameters
+    struct Patch
+    {
+        bool voiced = false;
+        float frequency = 0.0f; // carrier, Hz
+        float level = 0.0f;     // replaces main_amplitude, so the render has the power of the input
+        float modulationRatio = 1.0f;
+        float modulationAmplitude = 0.0f; // main_mod_amplitude, whose square is the modulation index in radians
+    };
+
+    constexpr int numHarmonics = 16;
+    using Harmonics = std::array<float, numHarmonics>;
+
+    // J_n(x) by its power series, accurate to double rounding for the orders and indices fitted here
+    inline double besselJ (int order, double x)
+    {
+        const auto halfX = x / 2.0;
+        auto term = std::pow (halfX, order) / std::tgamma (order + 1.0);
+        auto sum = term;
+        for (int k = 1; k < 60 && std::abs (term) > 1.0e-17 * std::abs (sum); ++k)
+        {
+            term *= -halfX * halfX / (k * (double) (k + order));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Signed amplitudes of the sine components of sin(carrier + index * sin(modulator)), indexed by harmonic of f0,
+    // with the carrier at carrierHarmonic * f0 and the modulator at ratio times the carrier. Sidebands below zero
+    // fold back with inverted sign; the one that lands on 0 Hz is sin(0), as the synth starts both phases at 0.
+    inline std::vector<double> fmComponents (int carrierHarmonic, double ratio, double index)
+    {
+        // Beyond this order J_n is below 1e-6 for every index the table holds
+        constexpr int maxOrder = 30;
+        std::vector<double> amplitudes ((size_t) std::lround (carrierHarmonic * (1.0 + maxOrder * ratio)) + 1, 0.0);
+
+        for (int n = -maxOrder; n <= maxOrder; ++n)
+        {
+            const auto frequency = carrierHarmonic * (1.0 + n * ratio);
+            const auto harmonic = (size_t) std::lround (std::abs (frequency));
+
+            // J_-n = (-1)^n J_n
+            auto amplitude = besselJ (std::abs (n), index) * (n < 0 && (n % 2) != 0 ? -1.0 : 1.0);
+            if (frequency < 0.0)
+                amplitude = -amplitude;
+            amplitudes[harmonic] += amplitude;
+        }
+
+        amplitudes[0] = 0.0;
+        return amplitudes;
+    }
+
+    // Analysis-by-synthesis model: every (carrier harmonic, ratio, index) the fit can return, with its spectrum.
+    // Held through juce::SharedResourcePointer, so a process builds it once however many instances analyse.
+    class SpectrumTable
+    {
+    public:
+        struct Entry
+        {
+            int carrierHarmonic;
+            float ratio, index;
+            Harmonics spectrum; // L2 normalised
+            float rms;          // of the patch at amplitude 1
+        };
+
+        static constexpr float maxIndex = 8.0f;
+        static constexpr float indexStep = 0.05f;
+
+        SpectrumTable()
+        {
+            // Ratios that keep every sideband on a harmonic of the detected pitch: the carrier is on the
+            // fundamental, or on the second harmonic with a half-integer ratio
+            constexpr std::array<std::pair<int, float>, 6> shapes {
+                { { 1, 1.0f }, { 1, 2.0f }, { 1, 3.0f }, { 1, 4.0f }, { 2, 0.5f }, { 2, 1.5f } }
+            };
+            const auto numIndices = (int) std::lround (maxIndex / indexStep) + 1;
+
+            entries.reserve (shapes.size() * (size_t) numIndices);
+            for (const auto& [carrierHarmonic, ratio] : shapes)
+            {
+                for (int i = 0; i < numIndices; ++i)
+                {
+                    const auto index = (float) i * indexStep;
+                    const auto components = fmComponents (carrierHarmonic, ratio, index);
+
+                    Harmonics spectrum {};
+                    auto sumOfSquares = 0.0;
+                    for (size_t h = 1; h < components.size(); ++h)
+                    {
+                        if (h <= (size_t) numHarmonics)
+                            spectrum[h - 1] = (float) std::abs (components[h]);
+                        sumOfSquares += components[h] * components[h];
+                    }
+
+                    entries.push_back ({ carrierHarmonic, ratio, index, normalise (spectrum), (float) std::sqrt (sumOfSquares / 2.0) });
+                }
+            }
+        }
+
+        // Entry whose spectrum is closest in shape (cosine similarity) to harmonics, of which only the first numValid count
+        const Entry& findClosest (const Harmonics& harmonics, int numValid) const
+        {
+            const auto* best = &entries.front();
+            auto bestScore = -1.0f;
+            for (const auto& entry : entries)
+            {
+                auto dot = 0.0f, norm = 0.0f;
+                for (int h = 0; h < numValid; ++h)
+                {
+                    dot += entry.spectrum[(size_t) h] * harmonics[(size_t) h];
+                    norm += entry.spectrum[(size_t) h] * entry.spectrum[(size_t) h];
+                }
+
+                const auto score = dot / std::sqrt (juce::jmax (norm, 1.0e-12f));
+                if (score > bestScore + 1.0e-6f)
+                {
+                    bestScore = score;
+                    best = &entry;
+                }
+            }
+            return *best;
+        }
+
+        static Harmonics normalise (Harmonics harmonics)
+        {
+            auto norm = 0.0f;
+            for (auto h : harmonics)
+                norm += h * h;
+
+            const auto scale = 1.0f / std::sqrt (juce::jmax (norm, 1.0e-12f));
+            for (auto& h : harmonics)
+                h *= scale;
+            return harmonics;
+        }
+
+    private:
+        std::vector<Entry> entries;
+    };
+
+    // YIN fundamental estimate between minimumFrequency and maximumFrequency, 0 if none. aperiodicity is the
+    // normalised difference at the chosen lag: near 0 for a clean periodic signal, near 1 for noise.
+    inline float estimatePitch (const float* frame,
+                                int frameSize,
+                                double sampleRate,
+                                double minimumFrequency,
+                                double maximumFrequency,
+                                float& aperiodicity)
+    {
+        constexpr float threshold = 0.15f;
+
+        const auto minimumLag = juce::jmax (2, (int) (sampleRate / maximumFrequency));
+        const auto maximumLag = juce::jmin (frameSize / 2, (int) (sampleRate / minimumFrequency) + 1);
+        const auto window = frameSize - maximumLag;
+        aperiodicity = 1.0f;
+
+        if (minimumLag + 2 >= maximumLag)
+            return 0.0f;
+
+        // Cumulative mean normalised difference, d[0] = 1 by definition
+        std::vector<float> difference ((size_t) maximumLag + 1, 1.0f);
+        auto runningSum = 0.0f;
+        for (int lag = 1; lag <= maximumLag; ++lag)
+        {
+            auto sum = 0.0f;
+            for (int i = 0; i < window; ++i)
+            {
+                const auto delta = frame[i] - frame[i + lag];
+                sum += delta * delta;
+            }
+            runningSum += sum;
+            difference[(size_t) lag] = runningSum > 0.0f ? sum * (float) lag / runningSum : 1.0f;
+        }
+
+        // First dip under the threshold, followed down to its minimum, otherwise the global minimum
+        auto lag = -1;
+        for (int l = minimumLag; l < maximumLag; ++l)
+        {
+            if (difference[(size_t) l] < threshold)
+            {
+                while (l + 1 < maximumLag && difference[(size_t) l + 1] < difference[(size_t) l])
+                    ++l;
+                lag = l;
+                break;
+            }
+        }
+        if (lag < 0)
+        {
+            lag = minimumLag;
+            for (int l = minimumLag + 1; l < maximumLag; ++l)
+                if (difference[(size_t) l] < difference[(size_t) lag])
+                    lag = l;
+        }
+
+        aperiodicity = difference[(size_t) lag];
+
+        // Parabolic interpolation between the neighbouring lags
+        const auto previous = difference[(size_t) lag - 1];
+        const auto next = difference[(size_t) lag + 1];
+        const auto curvature = previous - 2.0f * aperiodicity + next;
+        const auto offset = curvature > 0.0f ? 0.5f * (previous - next) / curvature : 0.0f;
+
+        return (float) (sampleRate / ((float) lag + juce::jlimit (-0.5f, 0.5f, offset)));
+    }
+
+    class Resynthesizer : private juce::Thread
+    {
+    public:
+        static constexpr double minimumFrequency = 50.0;
+        static constexpr double maximumFrequency = 2000.0;
+        static constexpr float silenceLevel = 0.003f; // about -50 dBFS peak
+        static constexpr float maximumAperiodicity = 0.3f;
+
+        Resynthesizer() : juce::Thread ("Resynthesis") {}
+        ~Resynthesizer() override { release(); }
+
+        // Sizes the frame for the rate, stopping the analysis thread. Message thread, not while processing.
+        void prepare (double newSampleRate)
+        {
+            setRunning (false);
+
+            sampleRate = newSampleRate;
+            frameSize = juce::nextPowerOfTwo ((int) std::ceil (2.0 * sampleRate / minimumFrequency));
+            hopSize = frameSize / 4;
+
+            fifo.setTotalSize (4 * frameSize);
+            fifoStorage.assign ((size_t) fifo.getTotalSize(), 0.0f);
+            frame.assign ((size_t) frameSize, 0.0f);
+            window.resize ((size_t) frameSize);
+            for (int i = 0; i < frameSize; ++i)
+                window[(size_t) i] = 0.5f - 0.5f * std::cos (juce::MathConstants<float>::twoPi * (float) i / (float) frameSize);
+        }
+
+        // Starts or stops the analysis thread, which only needs to run while the mode is on. Stopping
+        // publishes an empty patch, so a restart doesn't play the last one from before. Message thread.
+        void setRunning (bool shouldRun)
+        {
+            if (shouldRun && ! isThreadRunning() && frameSize > 0)
+            {
+                startThread (juce::Thread::Priority::low);
+            }
+            else if (! shouldRun)
+            {
+                stopThread (1000);
+                patches.publish ({});
+
+                // With the thread stopped this is the only reader. What is still queued is stale, the next
+                // analysis starts from silence.
+                fifo.finishedRead (fifo.getNumReady());
+                std::fill (frame.begin(), frame.end(), 0.0f);
+                numPendingSamples = 0;
+            }
+        }
+
+        bool isRunning() const { return isThreadRunning(); }
+
+        void release() { setRunning (false); }
+
+        // Audio thread: queues the average of the first numChannels channels. Input that does not fit is dropped.
+        template <typename SampleType>
+        void pushInput (const juce::AudioBuffer<SampleType>& buffer, int numChannels)
+        {
+            numChannels = juce::jmin (numChannels, buffer.getNumChannels());
+            if (numChannels <= 0 || fifoStorage.empty())
+                return;
+
+            const auto numSamples = juce::jmin (buffer.getNumSamples(), fifo.getFreeSpace());
+            numDroppedSamples.fetch_add (buffer.getNumSamples() - numSamples, std::memory_order_relaxed);
+
+            const auto gain = 1.0f / (float) numChannels;
+            auto sample = 0;
+            fifo.write (numSamples).forEach ([&] (int index) {
+                auto sum = 0.0f;
+                for (int channel = 0; channel < numChannels; ++channel)
+                    sum += (float) buffer.getSample (channel, sample);
+                fifoStorage[(size_t) index] = sum * gain;
+                ++sample;
+            });
+        }
+
+        // Audio thread: the patch of the most recent analysis
+        Patch getLatestPatch() const { return patches.read(); }
+
+        // Input lost because the analysis thread fell a whole ring buffer behind
+        juce::int64 getNumDroppedSamples() const { return numDroppedSamples.load (std::memory_order_relaxed); }
+
+        // One frame of frameSize samples to a patch. Called by the analysis thread, public for tests.
+        Patch analyse (const float* samples) const
+        {
+            Patch patch;
+
+            auto sumOfSquares = 0.0f;
+            for (int i = 0; i < frameSize; ++i)
+                sumOfSquares += samples[i] * samples[i];
+            const auto rms = std::sqrt (sumOfSquares / (float) frameSize);
+
+            // Peak of a sine of the same power until a patch is fitted
+            patch.level = juce::MathConstants<float>::sqrt2 * rms;
+            if (patch.level < silenceLevel)
+                return patch;
+
+            auto aperiodicity = 1.0f;
+            const auto pitch = estimatePitch (samples, frameSize, sampleRate, minimumFrequency, maximumFrequency, aperiodicity);
+            if (pitch <= 0.0f || aperiodicity > maximumAperiodicity)
+                return patch;
+
+            // Harmonics above Nyquist are neither measured nor compared
+            const auto numValid = juce::jlimit (1, numHarmonics, (int) (0.45 * sampleRate / pitch));
+            const auto& fit = getSpectra().findClosest (measureHarmonics (samples, pitch, numValid), numValid);
+
+            patch.voiced = true;
+            patch.frequency = pitch * (float) fit.carrierHarmonic;
+            patch.modulationRatio = fit.ratio;
+            patch.modulationAmplitude = std::sqrt (fit.index);
+            patch.level = rms / juce::jmax (fit.rms, 1.0e-3f);
+            return patch;
+        }
+
+        int getFrameSize() const { return frameSize; }
+        int getHopSize() const { return hopSize; }
+
+    private:
+        void run() override
+        {
+            // Built here rather than with the instance: plugins that never turn the mode on never pay for it
+            getSpectra();
+
+            std::vector<float> incoming ((size_t) fifo.getTotalSize());
+            const auto hopMilliseconds = juce::jmax (1, (int) (1000.0 * hopSize / sampleRate));
+
+            while (! threadShouldExit())
+            {
+                const auto numReady = fifo.getNumReady();
+                if (numReady == 0)
+                {
+                    wait (hopMilliseconds / 2 + 1);
+                    continue;
+                }
+
+                auto count = 0;
+                fifo.read (numReady).forEach ([&] (int index) { incoming[(size_t) count++] = fifoStorage[(size_t) index]; });
+
+                // Slide the frame to end at the newest sample
+                const auto keep = juce::jmax (0, frameSize - count);
+                std::copy (frame.end() - keep, frame.end(), frame.begin());
+                std::copy (incoming.begin() + (count - (frameSize - keep)), incoming.begin() + count, frame.begin() + keep);
+
+                numPendingSamples += count;
+                if (numPendingSamples >= hopSize)
+                {
+                    numPendingSamples = 0;
+                    patches.publish (analyse (frame.data()));
+                }
+            }
+        }
+
+        Harmonics measureHarmonics (const float* samples, float pitch, int numValid) const
+        {
+            Harmonics magnitudes {};
+            for (int h = 1; h <= numValid; ++h)
+            {
+                // Single DFT bin at h * pitch, the oscillator advanced by complex rotation
+                const auto omega = juce::MathConstants<double>::twoPi * h * pitch / sampleRate;
+                const auto stepCos = std::cos (omega), stepSin = std::sin (omega);
+                auto c = 1.0, s = 0.0, real = 0.0, imaginary = 0.0;
+
+                for (int i = 0; i < frameSize; ++i)
+                {
+                    const auto x = (double) (samples[i] * window[(size_t) i]);
+                    real += x * c;
+                    imaginary -= x * s;
+
+                    const auto nextC = c * stepCos - s * stepSin;
+                    s = s * stepCos + c * stepSin;
+                    c = nextC;
+                }
+                magnitudes[(size_t) h - 1] = (float) std::sqrt (real * real + imaginary * imaginary);
+            }
+            return SpectrumTable::normalise (magnitudes);
+        }
+
+        // Analysis thread only (or a test calling analyse() with the thread stopped)
+        const SpectrumTable& getSpectra() const
+        {
+            if (spectra == nullptr)
+                spectra = std::make_unique<juce::SharedResourcePointer<SpectrumTable>>();
+            return spectra->get();
+        }
+
+        double sampleRate = 44100.0;
+        int frameSize = 0, hopSize = 0;
+
+        juce::AbstractFifo fifo { 1 };
+        std::vector<float> fifoStorage;
+        std::atomic<juce::int64> numDroppedSamples { 0 };
+
+        // Analysis thread only
+        std::vector<float> frame, window;
+        int numPendingSamples = 0;
+
+        mutable std::unique_ptr<juce::SharedResourcePointer<SpectrumTable>> spectra;
+        AtomicDoubleBuffer<Patch> patches;
+    };
+} // namespace resynthesis
@@ -1,153 +1,77 @@
 #pragma once
 
 #include "Envelope.h"
+#include "Parameters.h"
 #include "juce_audio_processors/juce_audio_processors.h"
 #include "juce_core/juce_core.h"
 #include <JuceHeader.h>
 
-class Signal : private juce::AudioProcessorValueTreeState::Listener
+// The parameters of one FM operator (carrier or modulator) and its envelope, read from the registry.
+// Voices are rendered by VoiceBank, which reads its patch from the carrier Signal every control block.
+// SampleType selects the precision the values are handed out in: the processor keeps a Signal<float>
+// and a Signal<double> for hosts that ask for double precision processing (offline/mastering renders).
+template <typename SampleType>
+class Signal
 {
 public:
-    Signal (std::function<double (double)> generateFunc, double appSampleRate, juce::String signalName, AudioProcessorValueTreeState& state)
-        : apvts (state), name (signalName), sampleRate (appSampleRate), envelope (std::make_unique<Envelope> (name, state))
+    // parameterSet names the registry entries this operator reads, its modulator (if enabled) uses parameterSet.modulator
+    Signal (const params::Operator& parameterSet, const params::Registry& registry)
+        : parameters (parameterSet), envelope (std::make_unique<Envelope<SampleType>> (parameterSet, registry)), parameterRegistry (registry)
     {
-        setGenerateFunction (generateFunc);
-
-        enabled = apvts.getRawParameterValue (name + "_enabled");
-        amplitude = apvts.getRawParameterValue (name + "_amplitude");
-        modRatio = apvts.getRawParameterValue (name + "_modulation_ratio");
-
-        apvts.addParameterListener (name + "_modulation_ratio", this);
+        enabled = registry.getRawValue (parameters.enabled);
+        amplitude = registry.getRawValue (parameters.amplitude);
+        modRatio = registry.getRawValue (parameters.modulationRatio);
+
+        // Only the carrier has unison parameters, the getters fall back to a single centred copy
+        unisonVoices = registry.getRawValue (parameters.unisonVoices);
+        unisonDetune = registry.getRawValue (parameters.unisonDetune);
+        unisonSpread = registry.getRawValue (parameters.unisonSpread);
     }
 
-    ~Signal() override { apvts.removeParameterListener (name + "_modulation_ratio", this); }
-
-    void setSampleRate (double newSampleRate)
+    void enableModulation()
     {
-        sampleRate = newSampleRate;
-        if (mod)
-        {
-            mod->setSampleRate (newSampleRate);
-        }
+        jassert (parameters.modulator != nullptr);
+        mod = std::make_unique<Signal> (*parameters.modulator, parameterRegistry);
     }
 
-    void enableModulation (std::function<double (double)> generateFunc)
-    {
-        mod = std::make_unique<Signal> (std::move (generateFunc), sampleRate, name + "_mod", apvts);
-    }
-
-    void setGenerateFunction (std::function<double (double)> generateFunc) { generate = std::move (generateFunc); }
-
-    void updateFrequency (double newFrequency)
-    {
-        frequency = newFrequency;
+    void setEnabled (bool newState) { parameterRegistry.set (parameters.enabled, newState ? 1.0f : 0.0f); }
 
-        if (mod && mod->isEnabled())
-        {
-            auto modFrequency = getModulationRatio() * newFrequency;
-            mod->updateFrequency (modFrequency);
-        }
-    }
+    void updateAmplitude (double newAmplitude) { parameterRegistry.set (parameters.amplitude, (float) newAmplitude); }
 
-    double getSample (unsigned long channel, bool isNoteOn)
-    {
-        if (! isEnabled() || generate == nullptr)
-        {
-            return 0.0;
-        }
-
-        auto modSample = 0.0;
-        if (mod && mod->isEnabled())
-        {
-            modSample = mod->getSample (channel, true) * mod->getAmplitude();
-        }
-
-        double sample = generate (phase[channel] + modSample);
-        phaseIncrement = getPhaseIncrement (frequency);
-        phase[channel] += phaseIncrement;
-
-        auto envelopeCoefficient = isNoteOn ? 1.0 : 0.0;
-        if (envelope && envelope->isEnabled())
-        {
-            envelopeCoefficient = envelope->getCoefficient (channel, sampleRate, isNoteOn);
-        }
-        return sample * getAmplitude() * envelopeCoefficient;
-    }
-
-    void setEnabled (bool newState)
-    {
-        auto* param = apvts.getParameter (name + "_enabled");
-        param->beginChangeGesture();
-        param->setValueNotifyingHost (newState ? 1.0f : 0.0f);
-        param->endChangeGesture();
-        if (! isEnabled())
-        {
-            phase.fill (0.0);
-        }
-    }
+    void setModulationRatio (double newRatio) { parameterRegistry.set (parameters.modulationRatio, (float) newRatio); }
 
-    void updateAmplitude (double newAmplitude)
-    {
-        auto* param = apvts.getParameter (name + "_amplitude");
-        param->beginChangeGesture();
-        param->setValueNotifyingHost ((float) newAmplitude);
-        param->endChangeGesture();
-    }
+    bool isEnabled() const { return enabled->load() > 0.5f; }
 
-    static constexpr double twoPi = 2.0 * juce::MathConstants<double>::pi;
-    double getPhaseIncrement (double currentFrequency) { return (twoPi * currentFrequency) / sampleRate; }
+    SampleType getAmplitude() const { return (SampleType) amplitude->load(); }
 
-    void setModulationRatio (double newRatio)
-    {
-        auto* param = apvts.getParameter (name + "_modulation_ratio");
-        param->beginChangeGesture();
-        param->setValueNotifyingHost ((float) newRatio);
-        param->endChangeGesture();
-        updateFrequency (frequency);
-    }
+    float getModulationRatio() const { return modRatio->load(); }
 
-    bool isEnabled() const { return enabled->load() > 0.5f; }
+    int getUnisonVoices() const { return unisonVoices ? juce::jmax (1, juce::roundToInt (unisonVoices->load())) : 1; }
 
-    float getAmplitude() const { return amplitude->load(); }
+    // Cents between the centre and the outermost copy
+    SampleType getUnisonDetune() const { return unisonDetune ? (SampleType) unisonDetune->load() : SampleType (0); }
 
-    float getModulationRatio() const { return modRatio->load(); }
+    // 0 keeps every copy centred, 1 pans the outermost copies hard left and right
+    SampleType getUnisonSpread() const { return unisonSpread ? (SampleType) unisonSpread->load() : SampleType (0); }
 
-    inline Envelope& getEnvelope() { return *envelope; }
+    inline Envelope<SampleType>& getEnvelope() { return *envelope; }
 
     inline Signal& getModulation() { return *mod; }
 
-private:
-    void parameterChanged (const juce::String& parameterID, float newValue) override
-    {
-        // This method is called when a parameter changes.
-        // We can ignore the newValue here because we already have the current value stored in the member variables.
-        // However, we can use it to trigger any necessary updates or recalculations
-        // based on the parameter change.
-        juce::ignoreUnused (newValue);
-
-        // We only react to changes in the modulation ratio parameter because we need to recalculate the frequency
-        // when it changes. Other parameters are handled through their respective setters.
-        if (parameterID == name + "_modulation_ratio")
-        {
-            updateFrequency (frequency);
-        }
-    }
+    bool hasModulation() const { return mod != nullptr; }
 
-    juce::String name;
+private:
+    const params::Operator& parameters;
 
     std::atomic<float>* enabled;
     std::atomic<float>* amplitude;
     std::atomic<float>* modRatio;
+    std::atomic<float>* unisonVoices;
+    std::atomic<float>* unisonDetune;
+    std::atomic<float>* unisonSpread;
 
-    std::array<double, 2> phase { 0.0, 0.0 };
-    double phaseIncrement { 0.0 };
-    double frequency { 440.0 };
-    double sampleRate;
-
-    std::function<double (double)> generate;
-
-    std::unique_ptr<Envelope> envelope;
+    std::unique_ptr<Envelope<SampleType>> envelope;
     std::unique_ptr<Signal> mod { nullptr };
 
-    AudioProcessorValueTreeState& apvts;
+    const params::Registry& parameterRegistry;
 };
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// Audio callback deadline monitor.
+//
+// Every block is timed against its budget (numSamples / sampleRate) and the load, as a fraction of
+// that budget, goes into a histogram per stage. The audio thread is the only writer and uses plain
+// relaxed loads/stores, so recording costs a few clock reads and increments per block. Any other
+// thread can take a snapshot (p50/p99/max, overruns) at any time without locking.
+class Telemetry
+{
+public:
+    enum class Stage
+    {
+        Midi,
+        Oscillators,
+        Envelope,
+        Total
+    };
+
+    static constexpr size_t numStages = 4;
+    static constexpr int numBins = 400;
+    static constexpr double binWidth = 0.005; // loads of 200% and above land in the last bin
+
+    struct StageStats
+    {
+        double p50 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    struct Snapshot
+    {
+        std::uint64_t numBlocks = 0;
+        std::uint64_t numOverruns = 0;
+        std::array<StageStats, numStages> stages {};
+
+        const StageStats& operator[] (Stage stage) const { return stages[(size_t) stage]; }
+    };
+
+    void prepare (double newSampleRate) { sampleRate = newSampleRate; }
+
+    class ScopedBlock
+    {
+    public:
+        ScopedBlock (Telemetry& t, int numSamples) : telemetry (t) { telemetry.beginBlock (numSamples); }
+        ~ScopedBlock() { telemetry.endBlock(); }
+
+    private:
+        Telemetry& telemetry;
+        JUCE_DECLARE_NON_COPYABLE (ScopedBlock)
+    };
+
+    class ScopedStage
+    {
+    public:
+        ScopedStage (Telemetry& t, Stage s) : telemetry (t), stage (s), start (juce::Time::getHighResolutionTicks()) {}
+        ~ScopedStage() { telemetry.stageTicks[(size_t) stage] += juce::Time::getHighResolutionTicks() - start; }
+
+    private:
+        Telemetry& telemetry;
+        Stage stage;
+        juce::int64 start;
+        JUCE_DECLARE_NON_COPYABLE (ScopedStage)
+    };
+
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.numBlocks = numBlocks.load (std::memory_order_relaxed);
+        snapshot.numOverruns = numOverruns.load (std::memory_order_relaxed);
+
+        for (size_t stage = 0; stage < numStages; ++stage)
+        {
+            const auto& histogram = histograms[stage];
+            snapshot.stages[stage].p50 = histogram.getPercentile (0.5);
+            snapshot.stages[stage].p99 = histogram.getPercentile (0.99);
+            snapshot.stages[stage].max = histogram.max.load (std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+    // Called from the message thread, an increment racing with it may get lost which is fine for statistics
+    void reset()
+    {
+        for (auto& histogram : histograms)
+            histogram.reset();
+        numBlocks.store (0, std::memory_order_relaxed);
+        numOverruns.store (0, std::memory_order_relaxed);
+    }
+
+    static const char* getStageName (Stage stage)
+    {
+        switch (stage)
+        {
+            case Stage::Midi:
+                return "midi";
+            case Stage::Oscillators:
+                return "oscillators";
+            case Stage::Envelope:
+                return "envelope";
+            case Stage::Total:
+                break;
+        }
+        return "total";
+    }
+
+    // Headless dump for monitoring scripts, loads are fractions of the block deadline
+    juce::String toJSON() const
+    {
+        const auto snapshot = getSnapshot();
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty ("blocks", (juce::int64) snapshot.numBlocks);
+        root->setProperty ("overruns", (juce::int64) snapshot.numOverruns);
+
+        auto* stages = new juce::DynamicObject();
+        for (size_t stage = 0; stage < numStages; ++stage)
+        {
+            auto* stats = new juce::DynamicObject();
+            stats->setProperty ("p50", snapshot.stages[stage].p50);
+            stats->setProperty ("p99", snapshot.stages[stage].p99);
+            stats->setProperty ("max", snapshot.stages[stage].max);
+            stages->setProperty (getStageName ((Stage) stage), juce::var (stats));
+        }
+        root->setProperty ("stages", juce::var (stages));
+
+        return juce::JSON::toString (juce::var (root));
+    }
+
+private:
+    struct Histogram
+    {
+        std::array<std::atomic<std::uint32_t>, numBins> bins {};
+        std::atomic<double> max { 0.0 };
+
+        // Single writer, so no read-modify-write instructions are needed
+        void record (double load)
+        {
+            auto& bin = bins[(size_t) juce::jlimit (0, numBins - 1, (int) (load / binWidth))];
+            bin.store (bin.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            if (load > max.load (std::memory_order_relaxed))
+                max.store (load, std::memory_order_relaxed);
+        }
+
+        double getPercentile (double percentile) const
+        {
+            std::array<std::uint32_t, numBins> counts;
+            std::uint64_t total = 0;
+            for (size_t i = 0; i < counts.size(); ++i)
+            {
+                counts[i] = bins[i].load (std::memory_order_relaxed);
+                total += counts[i];
+            }
+
+            if (total == 0)
+                return 0.0;
+
+            const auto target = (std::uint64_t) std::ceil (percentile * (double) total);
+            std::uint64_t cumulative = 0;
+            for (size_t i = 0; i < counts.size(); ++i)
+            {
+                cumulative += counts[i];
+                if (cumulative >= target)
+                    return (double) (i + 1) * binWidth;
+            }
+            return (double) numBins * binWidth;
+        }
+
+        void reset()
+        {
+            for (auto& bin : bins)
+                bin.store (0, std::memory_order_relaxed);
+            max.store (0.0, std::memory_order_relaxed);
+        }
+    };
+
+    void beginBlock (int numSamples)
+    {
+        blockSamples = numSamples;
+        stageTicks.fill (0);
+        blockStart = juce::Time::getHighResolutionTicks();
+    }
+
+    void endBlock()
+    {
+        stageTicks[(size_t) Stage::Total] = juce::Time::getHighResolutionTicks() - blockStart;
+
+        if (blockSamples <= 0 || sampleRate <= 0.0)
+            return;
+
+        const auto budget = (double) blockSamples / sampleRate * ticksPerSecond;
+        for (size_t stage = 0; stage < numStages; ++stage)
+            histograms[stage].record ((double) stageTicks[stage] / budget);
+
+        if ((double) stageTicks[(size_t) Stage::Total] > budget)
+            numOverruns.store (numOverruns.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        numBlocks.store (numBlocks.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::array<Histogram, numStages> histograms;
+    std::atomic<std::uint64_t> numBlocks { 0 };
+    std::atomic<std::uint64_t> numOverruns { 0 };
+
+    // Audio thread only
+    std::array<juce::int64, numStages> stageTicks {};
+    juce::int64 blockStart = 0;
+    int blockSamples = 0;
+    double sampleRate = 0.0;
+    const double ticksPerSecond = (double) juce::Time::getHighResolutionTicksPerSecond();
+};
@@ -0,0 +1,231 @@
+#include "TimbreIndex.h"
+#include <JuceHeader.h>
+#include <cmath>
+#include <cstring>
+#include <torch/torch.h>
+
+namespace timbre
+{
+    namespace
+    {
+        constexpr int renderBlockSize = 512;
+        constexpr int renderNote = 60;
+        constexpr float renderVelocity = 0.8f;
+        constexpr double heldSeconds = 1.0;
+        constexpr double releaseSeconds = 0.5;
+
+        constexpr int fftSize = 2048;
+        constexpr int hopSize = 512;
+        constexpr double minMelFrequency = 30.0;
+        constexpr double maxMelFrequency = 16000.0;
+
+        constexpr std::int32_t indexMagic = 0x49544d46; // "FMTI"
+        constexpr std::int32_t indexVersion = 1;
+
+        double hertzToMel (double hertz) { return 2595.0 * std::log10 (1.0 + hertz / 700.0); }
+        double melToHertz (double mel) { return 700.0 * (std::pow (10.0, mel / 2595.0) - 1.0); }
+
+        // Triangular HTK mel filters, [numMelBands, fftSize / 2 + 1]
+        torch::Tensor makeMelFilterbank()
+        {
+            constexpr int numBins = fftSize / 2 + 1;
+            auto filterbank = torch::zeros ({ numMelBands, numBins });
+            auto weights = filterbank.accessor<float, 2>();
+
+            const auto minMel = hertzToMel (minMelFrequency);
+            const auto maxMel = hertzToMel (maxMelFrequency);
+            const auto binOf = [] (double mel) { return melToHertz (mel) * fftSize / renderSampleRate; };
+
+            for (int band = 0; band < numMelBands; ++band)
+            {
+                const auto lower = binOf (minMel + (maxMel - minMel) * band / (numMelBands + 1));
+                const auto centre = binOf (minMel + (maxMel - minMel) * (band + 1) / (numMelBands + 1));
+                const auto upper = binOf (minMel + (maxMel - minMel) * (band + 2) / (numMelBands + 1));
+
+                for (int bin = 0; bin < numBins; ++bin)
+                {
+                    const auto rising = ((double) bin - lower) / (centre - lower);
+                    const auto falling = (upper - (double) bin) / (upper - centre);
+                    weights[band][bin] = (float) juce::jmax (0.0, juce::jmin (rising, falling));
+                }
+            }
+            return filterbank;
+        }
+    } // namespace
+
+    PresetRenderer::PresetRenderer() : renderer (carrier, fastmath::SineAccuracy::Precise, renderSampleRate, renderBlockSize)
+    {
+        carrier.enableModulation();
+    }
+
+    void PresetRenderer::loadState (const juce::XmlElement& state)
+    {
+        // The APVTS state format: one PARAM child per parameter. A state of another plugin is ignored,
+        // which leaves a fresh processor at its defaults.
+        const auto isPluginState = state.hasTagName (params::stateType);
+        for (const auto& spec : params::specs)
+        {
+            const auto* child = isPluginState ? state.getChildByAttribute ("id", spec.key) : nullptr;
+            const auto value = child != nullptr ? (float) child->getDoubleAttribute ("value", spec.defaultValue) : spec.defaultValue;
+            parameters.set (spec.id, value);
+        }
+    }
+
+    std::vector<float> PresetRenderer::render (const juce::XmlElement& state)
+    {
+        // Only the parameters change between presets, the render goes through the same voice bank as the
+        // processor's float path without the audio callback around it
+        loadState (state);
+
+        const auto numHeldSamples = (int) (heldSeconds * renderSampleRate);
+        const auto numSamples = (int) ((heldSeconds + releaseSeconds) * renderSampleRate);
+
+        juce::MidiMessageSequence sequence;
+        sequence.addEvent (juce::MidiMessage::noteOn (1, renderNote, renderVelocity), 0.0);
+        sequence.addEvent (juce::MidiMessage::noteOff (1, renderNote), (double) numHeldSamples);
+
+        // One note never falls silent before its end, so this is always a single chunk. Serial keeps the
+        // indexer's preset-per-core parallelism free of nested threads.
+        std::vector<float> output ((size_t) numSamples), right ((size_t) numSamples);
+        renderer.render (sequence, output.data(), right.data(), numSamples, 1);
+
+        // Unison spread must not change the timbre, so the channels are summed
+        juce::FloatVectorOperations::add (output.data(), right.data(), numSamples);
+        juce::FloatVectorOperations::multiply (output.data(), 0.5f, numSamples);
+        return output;
+    }
+
+    std::vector<float> computeEmbeddings (const std::vector<std::vector<float>>& renders)
+    {
+        if (renders.empty())
+            return {};
+
+        torch::NoGradGuard noGrad;
+
+        const auto numRenders = (int64_t) renders.size();
+        const auto numSamples = (int64_t) renders.front().size();
+        auto audio = torch::empty ({ numRenders, numSamples });
+        for (int64_t i = 0; i < numRenders; ++i)
+        {
+            jassert ((int64_t) renders[(size_t) i].size() == numSamples);
+            std::memcpy (audio[i].data_ptr<float>(), renders[(size_t) i].data(), (size_t) numSamples * sizeof (float));
+        }
+
+        // One batched STFT over all renders, torch spreads it across the intra-op threads
+        static const auto window = torch::hann_window (fftSize);
+        static const auto filterbank = makeMelFilterbank();
+
+        const auto spectrum = torch::stft (audio, fftSize, hopSize, fftSize, window, false, true, true);
+        const auto power = spectrum.abs().square();
+        const auto logMel = torch::log (torch::matmul (filterbank, power) + 1.0e-10f);
+
+        // Level only shifts the means, removing it keeps quiet and loud versions of a sound together
+        const auto frameMeans = logMel.mean ({ 2 }, true);
+        const auto deviations = (logMel - frameMeans).square().mean ({ 2 }).sqrt();
+        auto means = frameMeans.squeeze (2);
+        means = means - means.mean ({ 1 }, true);
+
+        auto embeddings = torch::cat ({ means, deviations }, 1);
+        embeddings = embeddings / embeddings.square().sum ({ 1 }, true).sqrt().clamp_min (1.0e-12);
+        embeddings = embeddings.contiguous();
+
+        const auto* data = embeddings.data_ptr<float>();
+        return { data, data + numRenders * embeddingSize };
+    }
+
+    void Index::add (const juce::String& name, const float* embedding)
+    {
+        embeddings.insert (embeddings.end(), embedding, embedding + embeddingSize);
+        names.add (name);
+    }
+
+    bool Index::save (const juce::File& file) const
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+
+        juce::FileOutputStream stream (file);
+        if (stream.failedToOpen())
+            return false;
+
+        stream.writeInt (indexMagic);
+        stream.writeInt (indexVersion);
+        stream.writeInt (embeddingSize);
+        stream.writeInt (size());
+        stream.write (embeddings.data(), embeddings.size() * sizeof (float));
+        for (const auto& name : names)
+            stream.writeString (name);
+
+        stream.flush();
+        return stream.getStatus().wasOk();
+    }
+
+    bool Index::load (const juce::File& file)
+    {
+        juce::FileInputStream stream (file);
+        if (stream.failedToOpen())
+            return false;
+
+        if (stream.readInt() != indexMagic || stream.readInt() != indexVersion || stream.readInt() != embeddingSize)
+            return false;
+
+        // count comes from the file: a truncated or corrupt one must not size the allocation. Every preset
+        // takes its embedding plus at least the terminator of its name.
+        const auto count = stream.readInt();
+        const auto bytesPerPreset = (juce::int64) (embeddingSize * sizeof (float) + 1);
+        if (count < 0 || count * bytesPerPreset > stream.getTotalLength() - stream.getPosition())
+            return false;
+
+        std::vector<float> newEmbeddings ((size_t) count * embeddingSize);
+        const auto numBytes = (juce::int64) (newEmbeddings.size() * sizeof (float));
+        if (stream.read (newEmbeddings.data(), (size_t) numBytes) != numBytes)
+            return false;
+
+        juce::StringArray newNames;
+        newNames.ensureStorageAllocated (count);
+        for (int i = 0; i < count && ! stream.isExhausted(); ++i)
+            newNames.add (stream.readString());
+
+        if (newNames.size() != count)
+            return false;
+
+        embeddings = std::move (newEmbeddings);
+        names = std::move (newNames);
+        return true;
+    }
+
+    std::vector<Index::Match> Index::query (const float* embedding, int numResults) const
+    {
+        numResults = juce::jmin (numResults, size());
+        if (numResults <= 0)
+            return {};
+
+        torch::NoGradGuard noGrad;
+
+        // Views over the stored rows, no copy: one sgemv and a partial sort
+        const auto matrix = torch::from_blob (const_cast<float*> (embeddings.data()), { (int64_t) size(), (int64_t) embeddingSize });
+        const auto vector = torch::from_blob (const_cast<float*> (embedding), { (int64_t) embeddingSize });
+        const auto [similarities, indices] = torch::topk (torch::mv (matrix, vector), numResults);
+
+        std::vector<Match> matches;
+        matches.reserve ((size_t) numResults);
+        for (int i = 0; i < numResults; ++i)
+        {
+            const auto index = (int) indices[i].item<int64_t>();
+            matches.push_back ({ names[index], similarities[i].item<float>() });
+        }
+        return matches;
+    }
+
+    juce::File Index::getDefaultFile()
+    {
+        const auto path = juce::SystemStats::getEnvironmentVariable ("FMSYNTH_TIMBRE_INDEX", {});
+        if (path.isNotEmpty() && juce::File::isAbsolutePath (path))
+            return juce::File (path);
+
+        return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+            .getChildFile (JucePlugin_Manufacturer)
+            .getChildFile (JucePlugin_Name)
+            .getChildFile ("timbre.index");
+    }
+} // namespace timbre
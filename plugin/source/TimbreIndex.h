@@ -0,0 +1,74 @@
+#pragma once
+
+#include "OfflineRenderer.h"
+#include "Parameters.h"
+#include "SynthSignal.h"
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+// Timbre similarity search over a preset library.
+//
+// A preset (the plugin's APVTS state as XML) is rendered offline through the plugin's own DSP and
+// summarised by a log-mel embedding: per-band mean (level removed) and standard deviation over
+// time, L2 normalised so the dot product is the cosine similarity. The index is a flat row-major
+// matrix of embeddings; a query is one matrix-vector product and a top-k, which takes about a
+// millisecond for 100k presets, so no approximate structure is needed.
+namespace timbre
+{
+    constexpr double renderSampleRate = 44100.0;
+    constexpr int numMelBands = 32;
+    constexpr int embeddingSize = 2 * numMelBands;
+
+    // Renders presets through the plugin's voice bank without a plugin instance: it holds one preset's
+    // parameter values at a time, so an indexer worker builds one and reuses it for every preset.
+    // Not thread safe, each thread needs its own.
+    class PresetRenderer
+    {
+    public:
+        PresetRenderer();
+
+        // Middle C held for one second and released for half a second, mono. state is the plugin's
+        // state XML; parameters it leaves out play at their defaults.
+        std::vector<float> render (const juce::XmlElement& state);
+
+    private:
+        // The values AudioPluginAudioProcessor::setStateInformation would load
+        void loadState (const juce::XmlElement& state);
+
+        std::array<std::atomic<float>, params::numParameters> values;
+        params::Registry parameters { values };
+        Signal<float> carrier { params::mainCarrier, parameters };
+        OfflineRenderer<float> renderer;
+    };
+
+    // Embeds a batch of renders of equal length, returns renders.size() * embeddingSize values
+    std::vector<float> computeEmbeddings (const std::vector<std::vector<float>>& renders);
+
+    class Index
+    {
+    public:
+        struct Match
+        {
+            juce::String name;
+            float similarity;
+        };
+
+        void add (const juce::String& name, const float* embedding);
+        int size() const { return names.size(); }
+
+        // Returns false if the file cannot be written, or read as an index of this embedding size
+        bool save (const juce::File& file) const;
+        bool load (const juce::File& file);
+
+        std::vector<Match> query (const float* embedding, int numResults) const;
+
+        // FMSYNTH_TIMBRE_INDEX if set, otherwise next to the user's plugin settings
+        static juce::File getDefaultFile();
+
+    private:
+        std::vector<float> embeddings;
+        juce::StringArray names;
+    };
+} // namespace timbre
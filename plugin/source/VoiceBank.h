@@ -0,0 +1,576 @@
+#pragma once
+
+#include "DspKernels.h"
+#include "DspResources.h"
+#include "Envelope.h"
+#include "Expression.h"
+#include "SynthSignal.h"
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// Polyphonic FM voices stored as a structure of arrays.
+//
+// Each voice is a carrier/modulator pair with an ADSR envelope. Its state lives at the same index of a
+// set of aligned arrays (phases, increments, modulation index, level, envelope), so the render kernel
+// is one loop across voices per sample and the cost grows with the arithmetic, not with pointer
+// chasing. Operator parameters come from the carrier Signal (amplitude, ratio, modulation depth,
+// envelope settings); the bank only adds per-voice state.
+//
+// A note starts one voice per unison copy. The copies are detuned and panned symmetrically around the
+// note, start at scattered phases so their attacks don't add up, and since they are just more voices
+// the kernel vectorizes across them too. Output is mono unless some voice is panned off centre, so the
+// default patch renders once for all channels.
+//
+// Work is split in two passes per block, matching the telemetry stages:
+//  - updateControl() runs the envelopes and expression at control rate (every controlInterval samples)
+//    and writes the level each voice must reach at the end of each interval,
+//  - renderVoices() ramps to those levels and runs the oscillators.
+//
+// Between blocks the whole per-voice state can be taken out and put back as a plain Checkpoint, which
+// lets offline renders split a timeline across threads (see OfflineRenderer.h).
+template <typename SampleType>
+class VoiceBank
+{
+public:
+    static constexpr int maxVoices = 128;
+    static constexpr int controlInterval = 32;
+    static constexpr int maxUnisonVoices = 8;
+
+    // A stolen voice moves to one of these extra slots and fades out over the next control interval,
+    // so the note taking its place doesn't cut it off with a click
+    static constexpr int maxFadingVoices = 2 * kernels::voiceBlockSize;
+    static constexpr int numVoiceSlots = maxVoices + maxFadingVoices;
+
+    static_assert (maxVoices % kernels::voiceBlockSize == 0 && maxFadingVoices % kernels::voiceBlockSize == 0);
+
+    // Everything a voice carries from one block to the next. Plain data: copy it, store it, restore it
+    // into any bank prepared at the same sample rate and the render continues sample-exactly.
+    struct Checkpoint
+    {
+        std::array<phase::Accumulator, numVoiceSlots> carrierPhases, carrierIncrements, modulatorPhases, modulatorIncrements;
+        std::array<SampleType, numVoiceSlots> modulationIndices, modulationIndexSteps, levels, levelSteps, leftGains, rightGains;
+        std::array<EnvelopeState, numVoiceSlots> envelopeStates;
+        std::array<SampleType, numVoiceSlots> envelopeValues, gains, velocities, unisonOffsets, unisonScales;
+        std::array<int, numVoiceSlots> notes, expressionVoices;
+        std::array<bool, numVoiceSlots> held, started;
+        std::array<std::uint64_t, numVoiceSlots> startOrder;
+        std::uint64_t numNotesStarted;
+        int numRenderedVoices, numFadingVoices;
+        bool stereo;
+    };
+
+    VoiceBank (Signal<SampleType>& carrierSignal, fastmath::SineAccuracy sineAccuracy) : carrier (carrierSignal), accuracy (sineAccuracy)
+    {
+        reset();
+    }
+
+    // Only allocates when the block size grows, playing voices are kept and retuned to the new rate by the
+    // next updateControl(). Fetches the shared tables of the rate.
+    void prepare (double newSampleRate, int maximumBlockSize)
+    {
+        sampleRate = newSampleRate;
+        kernelTable = &kernels::select<SampleType>();
+        resources = resourceCache->get (sampleRate);
+
+        const auto maxIntervals = (maximumBlockSize + controlInterval - 1) / controlInterval;
+        levelTargets.resize ((size_t) (maxIntervals * numVoiceSlots));
+    }
+
+    // False until prepare() has fetched the tables and sized the scratch memory, notes must not start before
+    bool isPrepared() const { return resources != nullptr && kernelTable != nullptr; }
+
+    // Silences every voice immediately
+    void reset()
+    {
+        notes.fill (-1);
+        expressionVoices.fill (0);
+        held.fill (false);
+        started.fill (false);
+        velocities.fill (SampleType (0));
+        gains.fill (SampleType (0));
+        unisonOffsets.fill (SampleType (0));
+        unisonScales.fill (SampleType (1));
+        leftGains.fill (SampleType (1));
+        rightGains.fill (SampleType (1));
+        scratch.fill (SampleType (0));
+        envelopeStates.fill (EnvelopeState::Idle);
+        envelopeValues.fill (SampleType (0));
+        levels.fill (SampleType (0));
+        levelSteps.fill (SampleType (0));
+        modulationIndices.fill (SampleType (0));
+        modulationIndexSteps.fill (SampleType (0));
+        carrierPhases.fill (0);
+        modulatorPhases.fill (0);
+        carrierIncrements.fill (0);
+        modulatorIncrements.fill (0);
+        numRenderedVoices = 0;
+        numFadingVoices = 0;
+        stereo = false;
+    }
+
+    // expressionVoice is the ExpressionLanes voice (MIDI channel) the note follows
+    void noteOn (int note, float velocity, int expressionVoice)
+    {
+        jassert (resources != nullptr && juce::isPositiveAndBelow (note, DspResources::numMidiNotes));
+        // Undetuned copies would only play the same waveform louder, so they fold into one voice
+        const auto numCopies = carrier.getUnisonDetune() > SampleType (0) ? juce::jmin (carrier.getUnisonVoices(), maxUnisonVoices) : 1;
+
+        // Copies start at scattered phases and sum incoherently, so this keeps the loudness of a single voice
+        const auto scale = SampleType (1) / std::sqrt ((SampleType) numCopies);
+        const auto modulationRatio = followsOverride (expressionVoice) ? patchOverride->modulationRatio : (double) carrier.getModulationRatio();
+
+        for (int copy = 0; copy < numCopies; ++copy)
+        {
+            const auto v = (size_t) findVoiceToStart();
+            if (notes[v] >= 0)
+            {
+                fadeOut (v);
+            }
+
+            notes[v] = note;
+            expressionVoices[v] = expressionVoice;
+            velocities[v] = (SampleType) velocity;
+            held[v] = true;
+            started[v] = true;
+            startOrder[v] = ++numNotesStarted;
+            unisonOffsets[v] = numCopies == 1 ? SampleType (0) : SampleType (2 * copy) / SampleType (numCopies - 1) - SampleType (1);
+            unisonScales[v] = scale;
+
+            // Quadratic (Gauss sum) phases: the copies' phasors add up to exactly sqrt(numCopies), so the sum
+            // has the loudness of one voice from the attack on, even while the detune is tiny. Moving the
+            // modulator with the carrier keeps each copy the same waveform, just shifted in time.
+            const auto startCycles = double (copy * copy) / double (numCopies % 2 == 0 ? 2 * numCopies : numCopies);
+            carrierPhases[v] = phase::fromCycles (startCycles);
+            modulatorPhases[v] = phase::fromCycles (startCycles * modulationRatio);
+            envelopeStates[v] = EnvelopeState::Attack;
+            envelopeValues[v] = SampleType (0);
+            levels[v] = SampleType (0);
+
+            numRenderedVoices = juce::jmax (numRenderedVoices, padVoiceCount ((int) v + 1));
+        }
+    }
+
+    void noteOff (int note, int expressionVoice)
+    {
+        for (size_t v = 0; v < (size_t) maxVoices; ++v)
+        {
+            if (held[v] && notes[v] == note && expressionVoices[v] == expressionVoice)
+            {
+                held[v] = false;
+            }
+        }
+    }
+
+    // Releases every held voice, the tails still ring out
+    void allNotesOff() { held.fill (false); }
+
+    // Patch values that replace the carrier's parameters while set, e.g. estimated from audio input. Only
+    // the voices of notes on expressionVoice take them, notes played on other channels keep the patch.
+    struct PatchOverride
+    {
+        SampleType amplitude, modulationAmplitude;
+        double modulationRatio;
+        int expressionVoice;
+    };
+
+    void setPatchOverride (const std::optional<PatchOverride>& newOverride) { patchOverride = newOverride; }
+
+    // Control rate pass for the next numSamples samples: expression, modulation index, envelopes
+    void updateControl (const ExpressionLanes& expression, int numSamples)
+    {
+        jassert ((numSamples + controlInterval - 1) / controlInterval * numVoiceSlots <= (int) levelTargets.size());
+
+        freeIdleVoices();
+
+        // The modulator amplitude scales the index twice (depth times modulator level), the kernel takes cycles
+        const auto toModulationIndex = [] (SampleType modulationAmplitude)
+        { return modulationAmplitude * modulationAmplitude / juce::MathConstants<SampleType>::twoPi; };
+
+        const auto hasModulator = carrier.hasModulation();
+        const VoicePatch played { carrier.getAmplitude(),
+                                  hasModulator && carrier.getModulation().isEnabled() ? toModulationIndex (carrier.getModulation().getAmplitude())
+                                                                                      : SampleType (0),
+                                  (double) carrier.getModulationRatio() };
+        const auto tracked = patchOverride ? VoicePatch { patchOverride->amplitude,
+                                                          hasModulator ? toModulationIndex (patchOverride->modulationAmplitude) : SampleType (0),
+                                                          patchOverride->modulationRatio }
+                                           : played;
+
+        const auto detuneOctaves = (double) carrier.getUnisonDetune() / 1200.0;
+        const auto spread = carrier.getUnisonSpread();
+        stereo = false;
+
+        for (size_t v = 0; v < (size_t) numRenderedVoices; ++v)
+        {
+            if (notes[v] < 0)
+            {
+                modulationIndexSteps[v] = SampleType (0);
+                continue;
+            }
+
+            const auto& patch = followsOverride (expressionVoices[v]) ? tracked : played;
+            // Read from the table of the current rate every time, so voices ringing across a prepare() keep their pitch
+            const auto noteCycles = resources->noteCycles[(size_t) notes[v]];
+            const auto pitchRatio = expression.getPitchRatio (expressionVoices[v]) * std::exp2 (detuneOctaves * (double) unisonOffsets[v]);
+            carrierIncrements[v] = phase::fromCycles (noteCycles * pitchRatio);
+            modulatorIncrements[v] = phase::fromCycles (noteCycles * pitchRatio * patch.modulationRatio);
+
+            const auto target = patch.modulationIndex * (SampleType) expression.getModulationDepthScale (expressionVoices[v]);
+            if (started[v])
+            {
+                modulationIndices[v] = target;
+                started[v] = false;
+            }
+            modulationIndexSteps[v] = (target - modulationIndices[v]) / (SampleType) numSamples;
+            gains[v] = patch.amplitude * velocities[v] * unisonScales[v];
+
+            // Balance law: the centre keeps full level on both sides
+            const auto pan = unisonOffsets[v] * spread;
+            leftGains[v] = juce::jmin (SampleType (1), SampleType (1) - pan);
+            rightGains[v] = juce::jmin (SampleType (1), SampleType (1) + pan);
+            stereo = stereo || pan != SampleType (0);
+        }
+
+        auto& envelope = carrier.getEnvelope();
+        const auto envelopeEnabled = envelope.isEnabled();
+        const auto parameters = EnvelopeParameters::make (envelope, sampleRate);
+
+        auto* targets = levelTargets.data();
+        for (int start = 0; start < numSamples; start += controlInterval)
+        {
+            const auto length = juce::jmin (controlInterval, numSamples - start);
+            const auto factors = parameters.getFactors (length);
+
+            for (size_t v = 0; v < (size_t) numRenderedVoices; ++v)
+            {
+                if (notes[v] < 0)
+                {
+                    targets[v] = SampleType (0);
+                    continue;
+                }
+
+                const auto value = envelopeEnabled ? advanceEnvelope (v, parameters, factors, length) : advanceGate (v);
+                targets[v] = gains[v] * value;
+            }
+            targets += numRenderedVoices;
+        }
+
+        // The targets above fade stolen voices out within the first interval, the slots are free again
+        // for the next block. Cleared here rather than after rendering, so control-only passes agree.
+        numFadingVoices = 0;
+    }
+
+    // Renders all voices, numSamples must match the preceding updateControl() call.
+    // Without a right output, or when isStereo() is false, left receives the centred mono sum.
+    void renderVoices (SampleType* left, SampleType* right, int numSamples)
+    {
+        jassert (kernelTable != nullptr);
+
+        const kernels::VoiceLanes<SampleType> lanes { carrierPhases.data(),
+                                                      carrierIncrements.data(),
+                                                      modulatorPhases.data(),
+                                                      modulatorIncrements.data(),
+                                                      modulationIndices.data(),
+                                                      modulationIndexSteps.data(),
+                                                      levels.data(),
+                                                      levelSteps.data(),
+                                                      leftGains.data(),
+                                                      rightGains.data(),
+                                                      scratch.data(),
+                                                      numRenderedVoices };
+        const auto render = kernelTable->getVoiceRenderer (accuracy);
+
+        const auto* targets = levelTargets.data();
+        for (int start = 0; start < numSamples; start += controlInterval)
+        {
+            const auto length = juce::jmin (controlInterval, numSamples - start);
+            const auto scale = SampleType (1) / (SampleType) length;
+            for (int v = 0; v < numRenderedVoices; ++v)
+            {
+                levelSteps[(size_t) v] = (targets[v] - levels[(size_t) v]) * scale;
+            }
+
+            render (lanes, left + start, stereo && right != nullptr ? right + start : nullptr, length);
+            targets += numRenderedVoices;
+        }
+    }
+
+    // Only valid between blocks, i.e. not between updateControl() and renderVoices()
+    void getCheckpoint (Checkpoint& checkpoint) const
+    {
+        static_assert (std::is_trivially_copyable_v<Checkpoint>);
+        copyState (*this, checkpoint);
+    }
+
+    void restoreCheckpoint (const Checkpoint& checkpoint) { copyState (checkpoint, *this); }
+
+    // True when nothing rendered from the next block on depends on the current voices: every voice is free
+    // or has finished its release. A fresh bank would render the same from here, so offline renders can cut.
+    bool isSilent() const
+    {
+        if (numFadingVoices > 0)
+        {
+            return false;
+        }
+        for (size_t v = 0; v < (size_t) maxVoices; ++v)
+        {
+            if (notes[v] >= 0 && (held[v] || envelopeStates[v] != EnvelopeState::Idle))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // False once no voice can be heard: the carrier is disabled or every voice is free
+    bool isActive() const
+    {
+        if (! carrier.isEnabled())
+        {
+            return false;
+        }
+        return getNumActiveVoices() > 0;
+    }
+
+    // True when the last updateControl() found a voice panned off centre
+    bool isStereo() const { return stereo; }
+
+    int getNumActiveVoices() const
+    {
+        return (int) std::count_if (notes.begin(), notes.end(), [] (auto note) { return note >= 0; });
+    }
+
+private:
+    struct VoicePatch
+    {
+        SampleType amplitude, modulationIndex;
+        double modulationRatio;
+    };
+
+    bool followsOverride (int expressionVoice) const { return patchOverride && patchOverride->expressionVoice == expressionVoice; }
+
+    // Per-sample ADSR coefficients turned into per-interval ones, so the curves don't depend on the interval length
+    struct EnvelopeParameters
+    {
+        SampleType attackStep, decayFactor, sustain, releaseFactor;
+
+        static EnvelopeParameters make (const Envelope<SampleType>& envelope, double rate)
+        {
+            const auto samplesPerSecond = (SampleType) rate;
+            return { SampleType (1) / (envelope.getEnvelopeAttack() * samplesPerSecond),
+                     SampleType (1) - SampleType (1) / (envelope.getEnvelopeDecay() * samplesPerSecond),
+                     envelope.getEnvelopeSustain(),
+                     SampleType (1) - SampleType (1) / (envelope.getEnvelopeRelease() * samplesPerSecond) };
+        }
+
+        struct Factors
+        {
+            SampleType decay, release;
+        };
+
+        Factors getFactors (int length) const
+        {
+            return { std::pow (decayFactor, (SampleType) length), std::pow (releaseFactor, (SampleType) length) };
+        }
+    };
+
+    using EnvelopeFactors = typename EnvelopeParameters::Factors;
+
+    SampleType advanceEnvelope (size_t v, const EnvelopeParameters& parameters, const EnvelopeFactors& factors, int length)
+    {
+        constexpr auto threshold = (SampleType) Envelope<SampleType>::silenceThreshold;
+        auto& state = envelopeStates[v];
+        auto& value = envelopeValues[v];
+
+        if (! held[v] && state != EnvelopeState::Idle)
+        {
+            state = EnvelopeState::Release;
+        }
+
+        switch (state)
+        {
+            case EnvelopeState::Attack:
+                value += parameters.attackStep * (SampleType) length;
+                if (value >= SampleType (1) - threshold)
+                {
+                    value = SampleType (1);
+                    state = EnvelopeState::Decay;
+                }
+                break;
+
+            case EnvelopeState::Decay:
+                value = parameters.sustain + (value - parameters.sustain) * factors.decay;
+                if (value - parameters.sustain <= threshold)
+                {
+                    value = parameters.sustain;
+                    state = EnvelopeState::Sustain;
+                }
+                break;
+
+            case EnvelopeState::Release:
+                value *= factors.release;
+                if (value <= threshold)
+                {
+                    value = SampleType (0);
+                    state = EnvelopeState::Idle;
+                }
+                break;
+
+            case EnvelopeState::Sustain:
+            case EnvelopeState::Idle:
+                break;
+        }
+        return value;
+    }
+
+    // Without an envelope a voice is a plain gate
+    SampleType advanceGate (size_t v)
+    {
+        envelopeStates[v] = held[v] ? EnvelopeState::Sustain : EnvelopeState::Idle;
+        envelopeValues[v] = held[v] ? SampleType (1) : SampleType (0);
+        return envelopeValues[v];
+    }
+
+    void freeIdleVoices()
+    {
+        auto highestActive = 0;
+        for (size_t v = 0; v < (size_t) numRenderedVoices; ++v)
+        {
+            if (notes[v] >= 0 && ! held[v] && envelopeStates[v] == EnvelopeState::Idle)
+            {
+                notes[v] = -1;
+                levels[v] = SampleType (0);
+            }
+            if (notes[v] >= 0)
+            {
+                highestActive = (int) v + 1;
+            }
+        }
+        numRenderedVoices = numFadingVoices > 0 ? maxVoices + padVoiceCount (numFadingVoices) : padVoiceCount (highestActive);
+    }
+
+    // Hands the sound of a voice about to be stolen to a fading slot. A free voice has no notes[] entry
+    // there, so updateControl() ramps it to zero over one interval, still oscillating at its pitch.
+    // Only when more voices are stolen in one block than there are fading slots is one cut off.
+    void fadeOut (size_t v)
+    {
+        if (numFadingVoices == maxFadingVoices)
+        {
+            return;
+        }
+
+        const auto slot = (size_t) (maxVoices + numFadingVoices++);
+        carrierPhases[slot] = carrierPhases[v];
+        carrierIncrements[slot] = carrierIncrements[v];
+        modulatorPhases[slot] = modulatorPhases[v];
+        modulatorIncrements[slot] = modulatorIncrements[v];
+        modulationIndices[slot] = modulationIndices[v];
+        levels[slot] = levels[v];
+        leftGains[slot] = leftGains[v];
+        rightGains[slot] = rightGains[v];
+        numRenderedVoices = maxVoices + padVoiceCount (numFadingVoices);
+    }
+
+    // Lowest free slot keeps the rendered range short, otherwise the oldest note is stolen
+    int findVoiceToStart() const
+    {
+        auto oldest = 0;
+        for (size_t v = 0; v < (size_t) maxVoices; ++v)
+        {
+            if (notes[v] < 0)
+            {
+                return (int) v;
+            }
+            if (startOrder[v] < startOrder[(size_t) oldest])
+            {
+                oldest = (int) v;
+            }
+        }
+        return oldest;
+    }
+
+    // Shared by getCheckpoint() and restoreCheckpoint(), the bank and the checkpoint use the same member names
+    template <typename Source, typename Destination>
+    static void copyState (const Source& source, Destination& destination)
+    {
+        destination.carrierPhases = source.carrierPhases;
+        destination.carrierIncrements = source.carrierIncrements;
+        destination.modulatorPhases = source.modulatorPhases;
+        destination.modulatorIncrements = source.modulatorIncrements;
+        destination.modulationIndices = source.modulationIndices;
+        destination.modulationIndexSteps = source.modulationIndexSteps;
+        destination.levels = source.levels;
+        destination.levelSteps = source.levelSteps;
+        destination.leftGains = source.leftGains;
+        destination.rightGains = source.rightGains;
+        destination.envelopeStates = source.envelopeStates;
+        destination.envelopeValues = source.envelopeValues;
+        destination.gains = source.gains;
+        destination.velocities = source.velocities;
+        destination.unisonOffsets = source.unisonOffsets;
+        destination.unisonScales = source.unisonScales;
+        destination.notes = source.notes;
+        destination.expressionVoices = source.expressionVoices;
+        destination.held = source.held;
+        destination.started = source.started;
+        destination.startOrder = source.startOrder;
+        destination.numNotesStarted = source.numNotesStarted;
+        destination.numRenderedVoices = source.numRenderedVoices;
+        destination.numFadingVoices = source.numFadingVoices;
+        destination.stereo = source.stereo;
+    }
+
+    static int padVoiceCount (int numVoices)
+    {
+        return (numVoices + kernels::voiceBlockSize - 1) / kernels::voiceBlockSize * kernels::voiceBlockSize;
+    }
+
+    Signal<SampleType>& carrier;
+    fastmath::SineAccuracy accuracy;
+    double sampleRate { 44100.0 };
+    const kernels::Table<SampleType>* kernelTable { nullptr };
+    // Tables of the current rate, shared with every other instance in the process
+    juce::SharedResourcePointer<DspResourceCache> resourceCache;
+    std::shared_ptr<const DspResources> resources;
+
+    // Rendered by the kernel, voices [0, numRenderedVoices)
+    alignas (64) std::array<phase::Accumulator, numVoiceSlots> carrierPhases;
+    alignas (64) std::array<phase::Accumulator, numVoiceSlots> carrierIncrements;
+    alignas (64) std::array<phase::Accumulator, numVoiceSlots> modulatorPhases;
+    alignas (64) std::array<phase::Accumulator, numVoiceSlots> modulatorIncrements;
+    alignas (64) std::array<SampleType, numVoiceSlots> modulationIndices;
+    alignas (64) std::array<SampleType, numVoiceSlots> modulationIndexSteps;
+    alignas (64) std::array<SampleType, numVoiceSlots> levels;
+    alignas (64) std::array<SampleType, numVoiceSlots> levelSteps;
+    alignas (64) std::array<SampleType, numVoiceSlots> leftGains;
+    alignas (64) std::array<SampleType, numVoiceSlots> rightGains;
+    alignas (64) std::array<SampleType, numVoiceSlots> scratch;
+    int numRenderedVoices { 0 };
+    int numFadingVoices { 0 }; // in the slots from maxVoices on
+    bool stereo { false };
+
+    // Control rate state
+    std::array<EnvelopeState, numVoiceSlots> envelopeStates;
+    std::array<SampleType, numVoiceSlots> envelopeValues;
+    std::array<SampleType, numVoiceSlots> gains;
+    std::array<SampleType, numVoiceSlots> velocities;
+    std::array<SampleType, numVoiceSlots> unisonOffsets; // -1 to 1 across the copies of a note
+    std::array<SampleType, numVoiceSlots> unisonScales;
+    std::array<int, numVoiceSlots> notes;
+    std::array<int, numVoiceSlots> expressionVoices;
+    std::array<bool, numVoiceSlots> held;
+    std::array<bool, numVoiceSlots> started;
+    std::array<std::uint64_t, numVoiceSlots> startOrder {};
+    std::uint64_t numNotesStarted { 0 };
+
+    // One row of numRenderedVoices targets per control interval of the block
+    std::vector<SampleType> levelTargets;
+
+    // Not part of a Checkpoint: like the carrier's parameters it is an input, not voice state
+    std::optional<PatchOverride> patchOverride;
+};
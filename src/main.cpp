@@ -1,9 +1,25 @@
+#include <ATen/Parallel.h>
+#include <ATen/autocast_mode.h>
 #include <ATen/ops/mse_loss.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <optional>
 #include <random>
+#include <string>
 #include <torch/nn/modules/linear.h>
 #include <torch/torch.h>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 std::vector<std::pair<float, float>> getLine (float bias, float weight, float startX, float endX, float count)
 {
     float y { 0 };
@@ -81,16 +97,207 @@ torch::nn::Linear makeModel (int in, int out)
 
 torch::Tensor vec2tensor (const std::vector<float>& vec)
 {
-    torch::Tensor tensor = torch::empty ({ static_cast<int64_t> (vec.size()), 1 }, torch::kFloat);
-    for (size_t i = 0; i < vec.size(); ++i)
+    // One copy instead of an indexing op per element
+    return torch::from_blob (const_cast<float*> (vec.data()), { static_cast<int64_t> (vec.size()), 1 }, torch::kFloat).clone();
+}
+
+struct TrainerOptions
+{
+    int threads { 0 };        // intra-op, 0 keeps the libtorch default (one per physical core)
+    int interopThreads { 0 }; // inter-op, 0 keeps the default
+    bool pinThreads { false };
+    bool bf16 { false };
+    int logEvery { 100 }; // steps between loss evaluations, each one synchronises
+    int maxSteps { 1000000 };
+    std::string checkpointPath;
+    int checkpointEvery { 1000 };
+    bool resume { false };
+};
+
+void printUsage()
+{
+    std::cout << "Usage: testApp [options]\n"
+                 "  --threads N           intra-op threads (default: libtorch default)\n"
+                 "  --interop-threads N   inter-op threads (default: libtorch default)\n"
+                 "  --pin-threads         pin each intra-op thread to its own core (Linux)\n"
+                 "  --bf16                bfloat16 CPU autocast for the forward pass\n"
+                 "  --log-every N         evaluate and print the loss every N steps (default 100)\n"
+                 "  --max-steps N         stop after N steps even if the loss target is not reached\n"
+                 "  --checkpoint FILE     save model and optimizer state to FILE\n"
+                 "  --checkpoint-every N  steps between checkpoints (default 1000)\n"
+                 "  --resume              continue from --checkpoint if it exists"
+              << std::endl;
+}
+
+// The whole argument must be a decimal number of at least minimum
+std::optional<int> parseCount (const char* text, int minimum)
+{
+    int value = 0;
+    const auto end = text + std::strlen (text);
+    const auto [last, error] = std::from_chars (text, end, value);
+    if (error != std::errc() || last != end || value < minimum)
+        return std::nullopt;
+    return value;
+}
+
+std::optional<TrainerOptions> parseOptions (int argc, char* argv[])
+{
+    TrainerOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto hasValue = i + 1 < argc;
+
+        // Thread counts of 0 keep the libtorch default, the step counts need at least one step
+        std::optional<int> count;
+        if (arg == "--threads" && hasValue && (count = parseCount (argv[++i], 0)))
+            options.threads = *count;
+        else if (arg == "--interop-threads" && hasValue && (count = parseCount (argv[++i], 0)))
+            options.interopThreads = *count;
+        else if (arg == "--pin-threads")
+            options.pinThreads = true;
+        else if (arg == "--bf16")
+            options.bf16 = true;
+        else if (arg == "--log-every" && hasValue && (count = parseCount (argv[++i], 1)))
+            options.logEvery = *count;
+        else if (arg == "--max-steps" && hasValue && (count = parseCount (argv[++i], 1)))
+            options.maxSteps = *count;
+        else if (arg == "--checkpoint" && hasValue)
+            options.checkpointPath = argv[++i];
+        else if (arg == "--checkpoint-every" && hasValue && (count = parseCount (argv[++i], 1)))
+            options.checkpointEvery = *count;
+        else if (arg == "--resume")
+            options.resume = true;
+        else
+        {
+            std::cerr << "Invalid argument: " << argv[i] << std::endl;
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+// Pins intra-op thread k to the k-th CPU the process may run on, returns the number of threads pinned.
+// OMP_PROC_BIND/OMP_PLACES can't be set from here, libgomp reads them when it is loaded before main()
+// runs, so each worker pins itself from inside a parallel region. The workers persist between regions.
+int pinIntraOpThreads()
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO (&allowed);
+    if (sched_getaffinity (0, sizeof (allowed), &allowed) != 0)
+        return 0;
+
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET (cpu, &allowed))
+            cpus.push_back (cpu);
+
+    // Grain 1 over the thread count gives every thread of the team exactly one index
+    std::atomic<int> numPinned { 0 };
+    const auto numThreads = at::get_num_threads();
+    at::parallel_for (0, numThreads, 1, [&] (int64_t begin, int64_t end) {
+        for (auto i = begin; i < end; ++i)
+        {
+            cpu_set_t core;
+            CPU_ZERO (&core);
+            CPU_SET (cpus[(size_t) at::get_thread_num() % cpus.size()], &core);
+            if (pthread_setaffinity_np (pthread_self(), sizeof (core), &core) == 0)
+                ++numPinned;
+        }
+    });
+    return numPinned;
+#else
+    return 0;
+#endif
+}
+
+// Must run before the first torch call: the inter-op pool can only be sized before it starts
+void configureThreads (const TrainerOptions& options)
+{
+    if (options.interopThreads > 0)
+        at::set_num_interop_threads (options.interopThreads);
+    if (options.threads > 0)
+        torch::set_num_threads (options.threads);
+
+    if (options.pinThreads)
+    {
+        const auto numPinned = pinIntraOpThreads();
+        if (numPinned < at::get_num_threads())
+            std::cerr << "Pinned " << numPinned << " of " << at::get_num_threads() << " intra-op threads" << std::endl;
+    }
+
+    std::cout << at::get_parallel_info() << std::endl;
+}
+
+// Enables bfloat16 autocast on the CPU for its lifetime. Matmuls run in bf16, losses and reductions stay in float.
+struct ScopedCpuAutocast
+{
+    explicit ScopedCpuAutocast (bool enable) : enabled (enable)
+    {
+        if (! enabled)
+            return;
+        previousEnabled = at::autocast::is_autocast_enabled (at::kCPU);
+        previousDtype = at::autocast::get_autocast_dtype (at::kCPU);
+        at::autocast::set_autocast_dtype (at::kCPU, at::kBFloat16);
+        at::autocast::set_autocast_enabled (at::kCPU, true);
+    }
+
+    ~ScopedCpuAutocast()
     {
-        tensor[i][0] = vec[i];
+        if (! enabled)
+            return;
+        at::autocast::set_autocast_enabled (at::kCPU, previousEnabled);
+        at::autocast::set_autocast_dtype (at::kCPU, previousDtype);
+        at::autocast::clear_cache();
     }
-    return tensor;
+
+    bool enabled;
+    bool previousEnabled { false };
+    at::ScalarType previousDtype { at::kFloat };
+};
+
+// Model, optimizer and step in one archive, written to a temporary file and renamed so an
+// interrupted save never replaces a good checkpoint
+void saveCheckpoint (const std::string& path, torch::nn::Linear& net, torch::optim::Optimizer& optimizer, int64_t step)
+{
+    torch::serialize::OutputArchive archive, modelArchive, optimizerArchive;
+    net->save (modelArchive);
+    optimizer.save (optimizerArchive);
+    archive.write ("model", modelArchive);
+    archive.write ("optimizer", optimizerArchive);
+    archive.write ("step", torch::tensor (step));
+
+    const auto temporaryPath = path + ".tmp";
+    archive.save_to (temporaryPath);
+    std::filesystem::rename (temporaryPath, path);
 }
 
-int main()
+int64_t loadCheckpoint (const std::string& path, torch::nn::Linear& net, torch::optim::Optimizer& optimizer)
 {
+    torch::serialize::InputArchive archive, modelArchive, optimizerArchive;
+    archive.load_from (path);
+    archive.read ("model", modelArchive);
+    archive.read ("optimizer", optimizerArchive);
+    net->load (modelArchive);
+    optimizer.load (optimizerArchive);
+
+    torch::Tensor step;
+    archive.read ("step", step);
+    return step.item<int64_t>();
+}
+
+int main (int argc, char* argv[])
+{
+    const auto parsedOptions = parseOptions (argc, argv);
+    if (! parsedOptions)
+    {
+        printUsage();
+        return 1;
+    }
+    const auto& options = *parsedOptions;
+    configureThreads (options);
+
     int count = 1000;
     auto line = getnoisyLine (count);
 
@@ -108,22 +315,56 @@ int main()
     std::transform (line.begin(), line.end(), ys.begin(), [] (const auto& y) { return y.second; });
     auto target = vec2tensor (ys);
 
+    int64_t cnt = 0;
+    if (options.resume && ! options.checkpointPath.empty() && std::filesystem::exists (options.checkpointPath))
+    {
+        cnt = loadCheckpoint (options.checkpointPath, net, optimizer);
+        std::cout << "Resumed from " << options.checkpointPath << " at step " << cnt << std::endl;
+    }
+
+    // The loss is only read back every logEvery steps, in between the steps queue up without a host sync
+    const auto startTime = std::chrono::steady_clock::now();
+    const auto startStep = cnt;
     float lossValue = 1000.0f;
-    int cnt = 0;
-    while (lossValue > 0.5f)
+    torch::Tensor loss;
+    while (lossValue > 0.5f && cnt < options.maxSteps)
     {
         cnt++;
-        auto output = net->forward (input);
-
-        torch::Tensor loss = torch::mse_loss (output, target);
-        lossValue = loss.item<float>();
+        {
+            ScopedCpuAutocast autocast (options.bf16);
+            auto output = net->forward (input);
+            loss = torch::mse_loss (output, target);
+        }
 
         optimizer.zero_grad();
         loss.backward();
         optimizer.step();
+
+        if (cnt % options.logEvery == 0)
+        {
+            lossValue = loss.item<float>();
+            std::cout << "step " << cnt << " loss " << lossValue << std::endl;
+        }
+        if (! options.checkpointPath.empty() && cnt % options.checkpointEvery == 0)
+        {
+            saveCheckpoint (options.checkpointPath, net, optimizer, cnt);
+        }
+    }
+
+    if (! options.checkpointPath.empty())
+    {
+        saveCheckpoint (options.checkpointPath, net, optimizer, cnt);
+    }
+
+    // --max-steps can end the loop between two evaluations, the last step's loss is read back here
+    if (loss.defined())
+    {
+        lossValue = loss.item<float>();
     }
 
-    std::cout << "Training completed in " << cnt << " iterations with final loss: " << lossValue << std::endl;
+    const auto seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "Training completed in " << cnt << " iterations with final loss: " << lossValue << " ("
+              << (double) (cnt - startStep) / std::max (seconds, 1.0e-9) << " steps/s)" << std::endl;
 
     return 0;
 }
@@ -8,4 +8,25 @@ namespace audio_plugin_test {
         AudioPluginAudioProcessor processor {};
         ASSERT_TRUE(true);
     }
+
+    TEST(AudioPlugin, NoteOnBeforePrepareIsDropped)
+    {
+        AudioPluginAudioProcessor processor;
+        juce::AudioBuffer<float> buffer (2, 512);
+        buffer.clear();
+        juce::MidiBuffer midi;
+        midi.addEvent (juce::MidiMessage::noteOn (1, 60, 1.0f), 0);
+
+        processor.processBlock (buffer, midi);
+
+        EXPECT_EQ (processor.getVoices().getNumActiveVoices(), 0);
+        EXPECT_EQ (buffer.getMagnitude (0, 0, 512), 0.0f);
+
+        // Once prepared, notes play as usual
+        processor.setRateAndBufferSizeDetails (48000.0, 512);
+        processor.prepareToPlay (48000.0, 512);
+        processor.processBlock (buffer, midi);
+        EXPECT_EQ (processor.getVoices().getNumActiveVoices(), 1);
+        processor.releaseResources();
+    }
 }
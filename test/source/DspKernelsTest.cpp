@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include "DspKernels.h"
+#include <vector>
+
+namespace audio_plugin_test {
+    using kernels::InstructionSet;
+
+    constexpr InstructionSet allInstructionSets[] = { InstructionSet::Generic, InstructionSet::AVX2, InstructionSet::AVX512 };
+
+    struct ScopedKernelOverride
+    {
+        explicit ScopedKernelOverride (InstructionSet instructionSet) { kernels::setOverride (instructionSet); }
+        ~ScopedKernelOverride() { kernels::setOverride (std::nullopt); }
+    };
+
+    TEST(DspKernels, OverrideSelectsVariant)
+    {
+        for (auto instructionSet : allInstructionSets)
+        {
+            ScopedKernelOverride scopedOverride (instructionSet);
+            const auto expected = kernels::isSupported (instructionSet) ? instructionSet : kernels::getSelectedInstructionSet();
+            EXPECT_EQ (kernels::getSelectedInstructionSet(), expected) << kernels::getName (instructionSet);
+            EXPECT_EQ (kernels::select<float>().instructionSet, expected);
+            EXPECT_TRUE (kernels::isSupported (kernels::select<double>().instructionSet));
+        }
+    }
+
+    // Renders a fixed set of voices from a fresh state
+    void renderVoices (const kernels::Table<float>& table, fastmath::SineAccuracy accuracy, std::vector<float>& output)
+    {
+        constexpr auto numVoices = 2 * kernels::voiceBlockSize;
+        std::vector<phase::Accumulator> carrierPhases (numVoices), carrierIncrements (numVoices);
+        std::vector<phase::Accumulator> modulatorPhases (numVoices), modulatorIncrements (numVoices);
+        std::vector<float> indices (numVoices), indexSteps (numVoices), levels (numVoices), levelSteps (numVoices), scratch (numVoices);
+        std::vector<float> leftGains (numVoices, 1.0f), rightGains (numVoices, 0.5f);
+        for (size_t v = 0; v < (size_t) numVoices; ++v)
+        {
+            carrierIncrements[v] = phase::incrementForFrequency (110.0 * (double) (v + 1), 48000.0);
+            modulatorIncrements[v] = 2 * carrierIncrements[v];
+            indices[v] = 0.1f;
+            indexSteps[v] = 1.0e-4f;
+            levels[v] = 1.0f / numVoices;
+            levelSteps[v] = -1.0e-6f;
+        }
+
+        const kernels::VoiceLanes<float> lanes { carrierPhases.data(), carrierIncrements.data(), modulatorPhases.data(),
+                                                 modulatorIncrements.data(), indices.data(), indexSteps.data(),
+                                                 levels.data(), levelSteps.data(), leftGains.data(),
+                                                 rightGains.data(), scratch.data(), numVoices };
+
+        // First half mono, second half stereo with the right channel in place of the mono sum
+        const auto half = (int) output.size() / 2;
+        std::vector<float> left ((size_t) half);
+        const auto render = table.getVoiceRenderer (accuracy);
+        render (lanes, output.data(), nullptr, half);
+        render (lanes, left.data(), output.data() + half, half);
+    }
+
+    // Every variant the test machine can run must agree with the generic build
+    TEST(DspKernels, VariantsMatchGeneric)
+    {
+        constexpr int numSamples = 1000;
+        const auto& generic = kernels::get<float> (InstructionSet::Generic);
+        std::vector<float> expected (numSamples), actual (numSamples);
+
+        for (auto instructionSet : allInstructionSets)
+        {
+            if (! kernels::isSupported (instructionSet))
+                continue;
+
+            const auto& table = kernels::get<float> (instructionSet);
+            ASSERT_EQ (table.instructionSet, instructionSet);
+
+            for (auto accuracy : { fastmath::SineAccuracy::Fast, fastmath::SineAccuracy::Precise, fastmath::SineAccuracy::Exact })
+            {
+                renderVoices (generic, accuracy, expected);
+                renderVoices (table, accuracy, actual);
+                for (int i = 0; i < numSamples; ++i)
+                    EXPECT_NEAR (actual[(size_t) i], expected[(size_t) i], 1.0e-5f) << kernels::getName (instructionSet);
+            }
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include "DspResources.h"
+
+namespace audio_plugin_test {
+    TEST(DspResources, InstancesAtOneRateShareOneTable)
+    {
+        DspResourceCache cache;
+        const auto first = cache.get (48000.0);
+        const auto second = cache.get (48000.0);
+        const auto other = cache.get (44100.0);
+
+        EXPECT_EQ (first.get(), second.get());
+        EXPECT_NE (first.get(), other.get());
+        EXPECT_EQ (cache.getNumLiveResources(), 2);
+    }
+
+    TEST(DspResources, TablesAreFreedWithTheirLastUser)
+    {
+        DspResourceCache cache;
+        std::weak_ptr<const DspResources> released;
+        {
+            const auto resources = cache.get (96000.0);
+            released = resources;
+            EXPECT_EQ (cache.getNumLiveResources(), 1);
+        }
+        EXPECT_TRUE (released.expired());
+        EXPECT_EQ (cache.getNumLiveResources(), 0);
+
+        const auto rebuilt = cache.get (96000.0);
+        EXPECT_EQ (rebuilt->key.sampleRate, 96000.0);
+    }
+
+    TEST(DspResources, NoteTableMatchesEqualTemperament)
+    {
+        DspResourceCache cache;
+        const auto resources = cache.get (48000.0);
+        EXPECT_DOUBLE_EQ (resources->noteCycles[69], 440.0 / 48000.0);
+        EXPECT_DOUBLE_EQ (resources->noteCycles[81], 880.0 / 48000.0);
+
+        const auto retuned = cache.get (48000.0, 432.0);
+        EXPECT_NE (resources.get(), retuned.get());
+        EXPECT_DOUBLE_EQ (retuned->noteCycles[69], 432.0 / 48000.0);
+    }
+} // namespace audio_plugin_test
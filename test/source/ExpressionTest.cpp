@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include "Expression.h"
+
+namespace audio_plugin_test {
+    namespace
+    {
+        // MPE Configuration Message: RPN 6 on the master channel, data entry is the member channel count
+        void configureLowerZone (ExpressionLanes& lanes, int numMemberChannels)
+        {
+            lanes.handleMidiMessage (juce::MidiMessage::controllerEvent (1, 101, 0));
+            lanes.handleMidiMessage (juce::MidiMessage::controllerEvent (1, 100, 6));
+            lanes.handleMidiMessage (juce::MidiMessage::controllerEvent (1, 6, numMemberChannels));
+        }
+    } // namespace
+
+    TEST(ExpressionLanes, MemberChannelsAreIndependentVoices)
+    {
+        ExpressionLanes lanes;
+        configureLowerZone (lanes, 15);
+        EXPECT_EQ (lanes.getNumMemberChannels(), 15);
+
+        lanes.handleMidiMessage (juce::MidiMessage::noteOn (2, 60, 0.5f));
+        lanes.handleMidiMessage (juce::MidiMessage::noteOn (3, 64, 1.0f));
+        lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (2, 16383));
+        lanes.handleMidiMessage (juce::MidiMessage::channelPressureChange (3, 127));
+
+        for (int block = 0; block < 100; ++block)
+            lanes.advance (0.01);
+
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, 1), ExpressionLanes::memberPitchBendRange, 0.01f);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, 2), 0.0f, 1.0e-6f);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pressure, 2), 1.0f, 1.0e-3f);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pressure, 1), 0.0f, 1.0e-6f);
+        EXPECT_NEAR (lanes.getVelocity (1), 0.5f, 0.01f);
+        EXPECT_NEAR (lanes.getModulationDepthScale (2), 2.0f, 1.0e-2f);
+    }
+
+    TEST(ExpressionLanes, MasterPitchBendAppliesToEveryVoice)
+    {
+        ExpressionLanes lanes;
+        configureLowerZone (lanes, 15);
+        lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (1, 16383));
+
+        for (int block = 0; block < 100; ++block)
+            lanes.advance (0.01);
+
+        const auto expected = std::exp2 ((double) ExpressionLanes::masterPitchBendRange / 12.0);
+        for (int voice = 0; voice < ExpressionLanes::numVoices; ++voice)
+            EXPECT_NEAR (lanes.getPitchRatio (voice), expected, 1.0e-3);
+    }
+
+    TEST(ExpressionLanes, WithoutAZoneEveryChannelBendsByTheMasterRange)
+    {
+        ExpressionLanes lanes;
+        lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (5, 16383));
+        lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (1, 0));
+        lanes.advance (1.0);
+
+        EXPECT_EQ (lanes.getNumMemberChannels(), 0);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, 4), ExpressionLanes::masterPitchBendRange, 0.01f);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, 0), -ExpressionLanes::masterPitchBendRange, 0.01f);
+        EXPECT_NEAR (lanes.getPitchRatio (4), std::exp2 ((double) ExpressionLanes::masterPitchBendRange / 12.0), 1.0e-3);
+    }
+
+    TEST(ExpressionLanes, ChannelsOutsideTheZoneBendByTheMasterRange)
+    {
+        ExpressionLanes lanes;
+        configureLowerZone (lanes, 3);
+        lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (4, 16383));
+        lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (5, 16383));
+        lanes.advance (1.0);
+
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, 3), ExpressionLanes::memberPitchBendRange, 0.01f);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, 4), ExpressionLanes::masterPitchBendRange, 0.01f);
+
+        // A count of 0 ends the zone
+        configureLowerZone (lanes, 0);
+        EXPECT_EQ (lanes.getNumMemberChannels(), 0);
+        EXPECT_FALSE (lanes.isMemberChannel (2));
+    }
+
+    TEST(ExpressionLanes, InternalVoiceIsOutOfReachOfMidi)
+    {
+        ExpressionLanes lanes;
+        lanes.setTarget (ExpressionLanes::Pitch, ExpressionLanes::internalVoice, 0.5f);
+        lanes.noteOn (ExpressionLanes::internalVoice, 1.0f);
+
+        for (int channel = 1; channel <= 16; ++channel)
+        {
+            EXPECT_NE (ExpressionLanes::getVoiceForChannel (channel), ExpressionLanes::internalVoice);
+            lanes.handleMidiMessage (juce::MidiMessage::pitchWheel (channel, 0));
+            lanes.handleMidiMessage (juce::MidiMessage::channelPressureChange (channel, 127));
+        }
+        lanes.advance (1.0);
+
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pitch, ExpressionLanes::internalVoice), 0.5f, 1.0e-6f);
+        EXPECT_NEAR (lanes.getValue (ExpressionLanes::Pressure, ExpressionLanes::internalVoice), 0.0f, 1.0e-6f);
+    }
+
+    TEST(ExpressionLanes, NoteOnSnapsToInitialExpression)
+    {
+        ExpressionLanes lanes;
+        lanes.handleMidiMessage (juce::MidiMessage::controllerEvent (2, 74, 127));
+        lanes.handleMidiMessage (juce::MidiMessage::noteOn (2, 60, 1.0f));
+        EXPECT_FLOAT_EQ (lanes.getValue (ExpressionLanes::Timbre, 1), 1.0f);
+    }
+}
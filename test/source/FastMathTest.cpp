@@ -0,0 +1,285 @@
+#include <gtest/gtest.h>
+
+#include "FastMath.h"
+#include <JuceHeader.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace audio_plugin_test {
+    using fastmath::SineAccuracy;
+
+    // The Remez fit behind fastmath::detail::quarterCycleFit, run here because it is too heavy for constexpr
+    namespace remez
+    {
+        using fastmath::detail::pi;
+
+        double absolute (double x) { return x < 0.0 ? -x : x; }
+
+        // sin (pi / 2 * x) for x in [0, 1] by its Taylor series, independent of std::sin
+        double sinQuarterCycle (double x)
+        {
+            const auto a = 0.5 * pi * x;
+            auto term = a;
+            auto sum = a;
+            for (int k = 1; k < 20; ++k)
+            {
+                term *= -a * a / ((2.0 * k) * (2.0 * k + 1.0));
+                sum += term;
+            }
+            return sum;
+        }
+
+        template <std::size_t N>
+        double evaluateOdd (const std::array<double, N>& coefficients, double x)
+        {
+            const auto x2 = x * x;
+            auto p = coefficients[N - 1];
+            for (std::size_t k = N - 1; k-- > 0;)
+                p = p * x2 + coefficients[k];
+            return x * p;
+        }
+
+        // Gaussian elimination with partial pivoting on an augmented (N + 1) x (N + 2) system
+        template <std::size_t N>
+        std::array<double, N + 1> solve (std::array<std::array<double, N + 2>, N + 1> m)
+        {
+            constexpr std::size_t size = N + 1;
+
+            for (std::size_t col = 0; col < size; ++col)
+            {
+                auto pivot = col;
+                for (auto row = col + 1; row < size; ++row)
+                    if (absolute (m[row][col]) > absolute (m[pivot][col]))
+                        pivot = row;
+
+                std::swap (m[col], m[pivot]);
+
+                for (auto row = col + 1; row < size; ++row)
+                {
+                    const auto factor = m[row][col] / m[col][col];
+                    for (auto c = col; c <= size; ++c)
+                        m[row][c] -= factor * m[col][c];
+                }
+            }
+
+            std::array<double, size> x {};
+            for (auto row = size; row-- > 0;)
+            {
+                auto sum = m[row][size];
+                for (auto c = row + 1; c < size; ++c)
+                    sum -= m[row][c] * x[c];
+                x[row] = sum / m[row][row];
+            }
+            return x;
+        }
+
+        // Minimax fit of x * P (x^2) to sin (pi / 2 * x) on [0, 1], with N coefficients in P
+        template <std::size_t N>
+        std::array<double, N> remez()
+        {
+            constexpr std::size_t gridSize = 4096;
+
+            std::array<double, N + 1> reference {};
+            for (std::size_t i = 0; i <= N; ++i)
+                reference[i] = sinQuarterCycle ((double) (i + 1) / (double) (N + 1));
+
+            std::array<double, N> coefficients {};
+
+            for (int iteration = 0; iteration < 12; ++iteration)
+            {
+                std::array<std::array<double, N + 2>, N + 1> system {};
+                for (std::size_t i = 0; i <= N; ++i)
+                {
+                    const auto x = reference[i];
+                    auto power = x;
+                    for (std::size_t k = 0; k < N; ++k)
+                    {
+                        system[i][k] = power;
+                        power *= x * x;
+                    }
+                    system[i][N] = (i % 2 == 0) ? 1.0 : -1.0;
+                    system[i][N + 1] = sinQuarterCycle (x);
+                }
+
+                const auto solution = solve<N> (system);
+                for (std::size_t k = 0; k < N; ++k)
+                    coefficients[k] = solution[k];
+
+                // Exchange: keep the largest error of every sign-alternating run
+                std::array<double, N + 1> next {};
+                std::size_t count = 0;
+                double bestX = 0.0, bestError = 0.0;
+                int sign = 0;
+
+                for (std::size_t g = 1; g <= gridSize; ++g)
+                {
+                    const auto x = (double) g / (double) gridSize;
+                    const auto error = evaluateOdd (coefficients, x) - sinQuarterCycle (x);
+                    const auto errorSign = error >= 0.0 ? 1 : -1;
+
+                    if (sign != 0 && errorSign != sign)
+                    {
+                        if (count <= N)
+                            next[count] = bestX;
+                        ++count;
+                        bestError = 0.0;
+                    }
+
+                    sign = errorSign;
+                    if (absolute (error) >= bestError)
+                    {
+                        bestError = absolute (error);
+                        bestX = x;
+                    }
+                }
+
+                if (count <= N)
+                    next[count] = bestX;
+                ++count;
+
+                if (count != N + 1)
+                    break;
+
+                reference = next;
+            }
+
+            return coefficients;
+        }
+    } // namespace remez
+
+    template <std::size_t N>
+    void expectCommittedFit (double maxErrorDecibels)
+    {
+        const auto committed = fastmath::detail::quarterCycleFit<N>();
+        const auto fitted = remez::remez<N>();
+        for (std::size_t k = 0; k < N; ++k)
+            EXPECT_NEAR (committed[k], fitted[k], 1.0e-12) << N << " terms, coefficient " << k;
+
+        auto maxError = 0.0;
+        for (int i = 0; i <= 1000000; ++i)
+        {
+            const auto x = i / 1.0e6;
+            maxError = std::max (maxError, std::abs (remez::evaluateOdd (committed, x) - std::sin (0.5 * fastmath::detail::pi * x)));
+        }
+        EXPECT_LT (juce::Decibels::gainToDecibels (maxError, -400.0), maxErrorDecibels) << N << " terms";
+    }
+
+    TEST(FastMath, CommittedCoefficientsAreTheRemezFit)
+    {
+        expectCommittedFit<3> (-83.0);
+        expectCommittedFit<4> (-124.0);
+        expectCommittedFit<6> (-215.0);
+        expectCommittedFit<8> (-300.0);
+    }
+
+    template <SineAccuracy Accuracy, typename T>
+    double maxErrorAgainstStdSin (double start, double end)
+    {
+        constexpr int numPoints = 1000000;
+        double maxError = 0.0;
+        for (int i = 0; i <= numPoints; ++i)
+        {
+            const auto x = (T) (start + (end - start) * i / numPoints);
+            const auto error = std::abs ((double) fastmath::sin<Accuracy> (x) - std::sin ((double) x));
+            maxError = std::max (maxError, error);
+        }
+        return maxError;
+    }
+
+    template <SineAccuracy Accuracy, typename T>
+    void expectMaxError (double tolerance)
+    {
+        const auto twoPi = juce::MathConstants<double>::twoPi;
+        const auto maxError = maxErrorAgainstStdSin<Accuracy, T> (-2.0 * twoPi, 2.0 * twoPi);
+        std::cout << "max error " << maxError << " (" << juce::Decibels::gainToDecibels (maxError, -400.0) << " dB)" << std::endl;
+        EXPECT_LT (maxError, tolerance);
+    }
+
+    TEST(FastMath, FastTierIsWithin80dB)
+    {
+        expectMaxError<SineAccuracy::Fast, float> (1.0e-4);
+        expectMaxError<SineAccuracy::Fast, double> (1.0e-4);
+    }
+
+    TEST(FastMath, PreciseTierIsWithin120dB)
+    {
+        // Single precision is bounded by the rounding of the argument itself
+        expectMaxError<SineAccuracy::Precise, float> (4.0e-6);
+        expectMaxError<SineAccuracy::Precise, double> (1.0e-6);
+    }
+
+    TEST(FastMath, ExactTierMatchesStdSin)
+    {
+        expectMaxError<SineAccuracy::Exact, float> (4.0e-6);
+        expectMaxError<SineAccuracy::Exact, double> (1.0e-13);
+    }
+
+    TEST(FastMath, CosineIsShiftedSine)
+    {
+        for (double x = -10.0; x < 10.0; x += 0.01)
+            EXPECT_NEAR (fastmath::cos<SineAccuracy::Exact> (x), std::cos (x), 1.0e-13);
+    }
+
+#if JUCE_USE_SIMD
+    TEST(FastMath, SIMDMatchesScalar)
+    {
+        using Register = juce::dsp::SIMDRegister<float>;
+        alignas (Register::SIMDRegisterSize) float input[Register::SIMDNumElements];
+        alignas (Register::SIMDRegisterSize) float output[Register::SIMDNumElements];
+
+        for (float x = -20.0f; x < 20.0f; x += 0.37f)
+        {
+            for (size_t i = 0; i < Register::SIMDNumElements; ++i)
+                input[i] = x + 0.01f * (float) i;
+
+            fastmath::sin<SineAccuracy::Precise> (Register::fromRawArray (input)).copyToRawArray (output);
+
+            // Not bit-exact on targets where the compiler contracts the scalar path into FMAs
+            for (size_t i = 0; i < Register::SIMDNumElements; ++i)
+                EXPECT_NEAR (output[i], fastmath::sin<SineAccuracy::Precise> (input[i]), 1.0e-6f);
+        }
+    }
+#endif
+
+    template <typename Func>
+    double measureThroughput (Func&& process, int numSamples)
+    {
+        constexpr int numRuns = 200;
+        const auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < numRuns; ++run)
+            process();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return (double) numRuns * numSamples / elapsed.count() / 1.0e6;
+    }
+
+    // Not a pass/fail test: reports Msamples/s per tier next to std::sin for the current build
+    TEST(FastMathBenchmark, ThroughputAgainstStdSin)
+    {
+        constexpr int numSamples = 8192;
+        std::vector<float> input (numSamples), output (numSamples);
+        for (int i = 0; i < numSamples; ++i)
+            input[(size_t) i] = 0.01f * (float) i;
+
+        const auto reference = measureThroughput (
+            [&]
+            {
+                for (int i = 0; i < numSamples; ++i)
+                    output[(size_t) i] = std::sin (input[(size_t) i]);
+            },
+            numSamples);
+        const auto fast = measureThroughput ([&] { fastmath::sin<SineAccuracy::Fast> (input.data(), output.data(), numSamples); }, numSamples);
+        const auto precise = measureThroughput ([&] { fastmath::sin<SineAccuracy::Precise> (input.data(), output.data(), numSamples); },
+                                                numSamples);
+        const auto exact = measureThroughput ([&] { fastmath::sin<SineAccuracy::Exact> (input.data(), output.data(), numSamples); }, numSamples);
+
+        std::cout << "Msamples/s  std::sin " << reference << "  fast " << fast << "  precise " << precise << "  exact " << exact << std::endl;
+        RecordProperty ("std_sin_msps", juce::String (reference).toStdString());
+        RecordProperty ("fast_msps", juce::String (fast).toStdString());
+        RecordProperty ("precise_msps", juce::String (precise).toStdString());
+        RecordProperty ("exact_msps", juce::String (exact).toStdString());
+
+        EXPECT_GT (reference, 0.0);
+    }
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include "PluginProcessor.h"
+#include <chrono>
+#include <vector>
+
+// End-to-end regression renders.
+//
+// Each scenario drives the processor headlessly with scripted MIDI and parameter automation and compares
+// the output against a stored golden render in test/golden/<name>.wav (32 bit float). A missing golden
+// is written from the current build and fails the test, so it cannot pass unnoticed; set
+// FMSYNTH_UPDATE_GOLDEN=1 to rewrite existing ones after an intended change to the sound. The generic
+// kernels are forced so goldens do not depend on the instruction set of the machine.
+//
+// Every scenario also has a throughput budget in output samples per second, checked in optimized
+// builds only, so a change that makes the DSP much slower fails like one that changes its output.
+// The budgets sit at a fifth or less of what a desktop machine renders, so only a real slowdown trips
+// them; set FMSYNTH_SKIP_BUDGETS=1 on shared or heavily loaded runners to check the output only.
+namespace audio_plugin_test {
+    namespace
+    {
+        constexpr double sampleRate = 48000.0;
+        constexpr int blockSize = 512;
+        constexpr int numChannels = 2;
+
+        struct TimedMidi
+        {
+            int sample;
+            juce::MidiMessage message;
+        };
+
+        struct Automation
+        {
+            int sample;
+            params::Id parameter;
+            float value;
+        };
+
+        struct Scenario
+        {
+            const char* name;
+            bool doublePrecision;
+            double seconds;
+            std::vector<std::pair<params::Id, float>> settings;
+            std::vector<TimedMidi> midi;
+            std::vector<Automation> automation;
+            float tolerance;
+            double minimumSamplesPerSecond;
+        };
+
+        int samplesAt (double seconds) { return (int) (seconds * sampleRate); }
+
+        std::vector<Scenario> makeScenarios()
+        {
+            std::vector<Scenario> scenarios;
+
+            scenarios.push_back ({ "SingleNote",
+                                   false,
+                                   2.0,
+                                   {},
+                                   { { 0, juce::MidiMessage::noteOn (1, 69, 1.0f) }, { samplesAt (1.0), juce::MidiMessage::noteOff (1, 69) } },
+                                   {},
+                                   1.0e-6f,
+                                   20.0 * sampleRate });
+
+            Scenario chord { "UnisonChord",
+                             false,
+                             2.0,
+                             { { params::MainUnisonVoices, 4.0f }, { params::MainUnisonDetune, 25.0f }, { params::MainUnisonSpread, 1.0f } },
+                             {},
+                             {},
+                             1.0e-6f,
+                             10.0 * sampleRate };
+            for (int k = 0; k < 4; ++k)
+            {
+                const auto note = 60 + 4 * k - (k == 3 ? 1 : 0);
+                chord.midi.push_back ({ k * 2400, juce::MidiMessage::noteOn (1, note, 0.5f + 0.1f * (float) k) });
+                chord.midi.push_back ({ samplesAt (1.0) + k * 4800, juce::MidiMessage::noteOff (1, note) });
+            }
+            scenarios.push_back (std::move (chord));
+
+            // MPE: a lower zone set up by an MPE Configuration Message (RPN 6), then one note per member channel,
+            // each with its own bend, pressure and timbre, plus patch automation
+            Scenario expression { "MpeExpression",
+                                  true,
+                                  3.0,
+                                  {},
+                                  { { 0, juce::MidiMessage::controllerEvent (1, 101, 0) },
+                                    { 0, juce::MidiMessage::controllerEvent (1, 100, 6) },
+                                    { 0, juce::MidiMessage::controllerEvent (1, 6, 15) },
+                                    { 0, juce::MidiMessage::noteOn (2, 57, 0.8f) },
+                                    { samplesAt (0.25), juce::MidiMessage::noteOn (3, 64, 0.6f) },
+                                    { samplesAt (2.5), juce::MidiMessage::noteOff (2, 57) },
+                                    { samplesAt (2.5), juce::MidiMessage::noteOff (3, 64) } },
+                                  { { samplesAt (1.0), params::MainModulationRatio, 3.0f },
+                                    { samplesAt (1.5), params::MainModAmplitude, 2.0f },
+                                    { samplesAt (2.0), params::MainEnvelopeRelease, 0.3f } },
+                                  1.0e-6f,
+                                  5.0 * sampleRate };
+            for (int step = 0; step < 40; ++step)
+            {
+                const auto time = samplesAt (0.05 * step);
+                expression.midi.push_back ({ time, juce::MidiMessage::pitchWheel (2, 8192 + step * 100) });
+                expression.midi.push_back ({ time, juce::MidiMessage::channelPressureChange (3, (step * 3) % 128) });
+                expression.midi.push_back ({ time, juce::MidiMessage::controllerEvent (3, 74, 127 - (step * 3) % 128) });
+            }
+            scenarios.push_back (std::move (expression));
+
+            Scenario dense { "DensePolyphony", false, 4.0, { { params::MainUnisonVoices, 2.0f } }, {}, {}, 1.0e-5f, 2.0 * sampleRate };
+            for (int k = 0; k < 48; ++k)
+            {
+                const auto note = 36 + (k * 5) % 48;
+                dense.midi.push_back ({ k * 1000, juce::MidiMessage::noteOn (1 + k % 2, note, 0.7f) });
+                dense.midi.push_back ({ k * 1000 + samplesAt (1.5), juce::MidiMessage::noteOff (1 + k % 2, note) });
+            }
+            scenarios.push_back (std::move (dense));
+
+            return scenarios;
+        }
+
+        struct RenderResult
+        {
+            juce::AudioBuffer<float> output;
+            double samplesPerSecond;
+        };
+
+        template <typename SampleType>
+        RenderResult render (AudioPluginAudioProcessor& processor, const Scenario& scenario)
+        {
+            const auto numSamples = samplesAt (scenario.seconds);
+            RenderResult result { juce::AudioBuffer<float> (numChannels, numSamples), 0.0 };
+
+            juce::AudioBuffer<SampleType> buffer (numChannels, blockSize);
+            juce::MidiBuffer midi;
+            std::chrono::steady_clock::duration elapsed {};
+
+            for (int start = 0; start < numSamples; start += blockSize)
+            {
+                const auto length = juce::jmin (blockSize, numSamples - start);
+                const auto end = start + length;
+
+                // Automation lands on block boundaries, like host automation without sample-accurate parameters
+                for (const auto& automation : scenario.automation)
+                    if (automation.sample >= start && automation.sample < end)
+                        processor.getParameters().set (automation.parameter, automation.value);
+
+                midi.clear();
+                for (const auto& event : scenario.midi)
+                    if (event.sample >= start && event.sample < end)
+                        midi.addEvent (event.message, event.sample - start);
+
+                buffer.setSize (numChannels, length, false, false, true);
+                buffer.clear();
+
+                const auto before = std::chrono::steady_clock::now();
+                processor.processBlock (buffer, midi);
+                elapsed += std::chrono::steady_clock::now() - before;
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                    for (int i = 0; i < length; ++i)
+                        result.output.setSample (channel, start + i, (float) buffer.getSample (channel, i));
+            }
+
+            result.samplesPerSecond = numSamples / juce::jmax (1.0e-9, std::chrono::duration<double> (elapsed).count());
+            return result;
+        }
+
+        RenderResult render (const Scenario& scenario)
+        {
+            AudioPluginAudioProcessor processor;
+            for (const auto& [parameter, value] : scenario.settings)
+                processor.getParameters().set (parameter, value);
+
+            processor.setProcessingPrecision (scenario.doublePrecision ? juce::AudioProcessor::doublePrecision
+                                                                       : juce::AudioProcessor::singlePrecision);
+            processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+            processor.prepareToPlay (sampleRate, blockSize);
+
+            auto result = scenario.doublePrecision ? render<double> (processor, scenario) : render<float> (processor, scenario);
+            processor.releaseResources();
+            return result;
+        }
+
+        bool isEnvironmentFlagSet (const char* name) { return juce::SystemStats::getEnvironmentVariable (name, {}) == "1"; }
+
+        juce::File getGoldenFile (const Scenario& scenario)
+        {
+            return juce::File (FMSYNTH_GOLDEN_DIR).getChildFile (juce::String (scenario.name) + ".wav");
+        }
+
+        // IEEE float WAV, written by hand so the format is fixed regardless of the JUCE writer defaults
+        bool writeGolden (const juce::File& file, const juce::AudioBuffer<float>& audio)
+        {
+            file.getParentDirectory().createDirectory();
+            file.deleteFile();
+
+            juce::FileOutputStream stream (file);
+            if (stream.failedToOpen())
+                return false;
+
+            const auto dataBytes = audio.getNumSamples() * audio.getNumChannels() * (int) sizeof (float);
+            stream.write ("RIFF", 4);
+            stream.writeInt (36 + dataBytes);
+            stream.write ("WAVEfmt ", 8);
+            stream.writeInt (16);
+            stream.writeShort (3); // WAVE_FORMAT_IEEE_FLOAT
+            stream.writeShort ((short) audio.getNumChannels());
+            stream.writeInt ((int) sampleRate);
+            stream.writeInt ((int) sampleRate * audio.getNumChannels() * (int) sizeof (float));
+            stream.writeShort ((short) (audio.getNumChannels() * (int) sizeof (float)));
+            stream.writeShort (32);
+            stream.write ("data", 4);
+            stream.writeInt (dataBytes);
+
+            for (int i = 0; i < audio.getNumSamples(); ++i)
+                for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+                    stream.writeFloat (audio.getSample (channel, i));
+
+            stream.flush();
+            return stream.getStatus().wasOk();
+        }
+
+        std::unique_ptr<juce::AudioBuffer<float>> readGolden (const juce::File& file)
+        {
+            juce::WavAudioFormat format;
+            std::unique_ptr<juce::AudioFormatReader> reader (format.createReaderFor (new juce::FileInputStream (file), true));
+            if (reader == nullptr)
+                return nullptr;
+
+            auto audio = std::make_unique<juce::AudioBuffer<float>> ((int) reader->numChannels, (int) reader->lengthInSamples);
+            reader->read (audio.get(), 0, (int) reader->lengthInSamples, 0, true, true);
+            return audio;
+        }
+
+        void PrintTo (const Scenario& scenario, std::ostream* stream) { *stream << scenario.name; }
+
+        struct ScopedGenericKernels
+        {
+            ScopedGenericKernels() { kernels::setOverride (kernels::InstructionSet::Generic); }
+            ~ScopedGenericKernels() { kernels::setOverride (std::nullopt); }
+        };
+    } // namespace
+
+    class GoldenRender : public ::testing::TestWithParam<Scenario>
+    {
+    };
+
+    TEST_P(GoldenRender, MatchesGoldenWithinBudget)
+    {
+        const auto& scenario = GetParam();
+        const ScopedGenericKernels genericKernels;
+        const auto result = render (scenario);
+
+        RecordProperty ("samples_per_second", juce::String (result.samplesPerSecond, 0).toStdString());
+#ifdef NDEBUG
+        if (! isEnvironmentFlagSet ("FMSYNTH_SKIP_BUDGETS"))
+            EXPECT_GE (result.samplesPerSecond, scenario.minimumSamplesPerSecond) << "rendering " << scenario.name << " got too slow";
+#endif
+
+        const auto file = getGoldenFile (scenario);
+        if (isEnvironmentFlagSet ("FMSYNTH_UPDATE_GOLDEN"))
+        {
+            ASSERT_TRUE (writeGolden (file, result.output)) << file.getFullPathName();
+            return;
+        }
+
+        // A missing golden is written from this build so it can be reviewed and committed, the run still fails
+        const auto golden = readGolden (file);
+        if (golden == nullptr)
+        {
+            ASSERT_TRUE (writeGolden (file, result.output)) << file.getFullPathName();
+            FAIL() << "no golden render at " << file.getFullPathName() << ", wrote one from this build: listen to it, check "
+                   << "that a second run passes and commit it";
+        }
+
+        ASSERT_EQ (golden->getNumChannels(), result.output.getNumChannels());
+        ASSERT_EQ (golden->getNumSamples(), result.output.getNumSamples());
+
+        for (int channel = 0; channel < golden->getNumChannels(); ++channel)
+        {
+            for (int i = 0; i < golden->getNumSamples(); ++i)
+            {
+                const auto expected = golden->getSample (channel, i);
+                const auto actual = result.output.getSample (channel, i);
+                ASSERT_NEAR (actual, expected, scenario.tolerance) << scenario.name << ", channel " << channel << ", sample " << i;
+            }
+        }
+    }
+
+    INSTANTIATE_TEST_SUITE_P (Scenarios,
+                              GoldenRender,
+                              ::testing::ValuesIn (makeScenarios()),
+                              [] (const ::testing::TestParamInfo<Scenario>& info) { return std::string (info.param.name); });
+} // namespace audio_plugin_test
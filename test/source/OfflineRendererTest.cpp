@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include "OfflineRenderer.h"
+#include "PluginProcessor.h"
+#include <vector>
+
+namespace audio_plugin_test {
+    namespace
+    {
+        constexpr double sampleRate = 48000.0;
+        constexpr int blockSize = 256;
+        constexpr int numSamples = 10 * 48000;
+
+        // Three note chords every second with gaps between them, plus some pitch bend
+        juce::MidiMessageSequence makeSequence()
+        {
+            juce::MidiMessageSequence sequence;
+            for (int second = 0; second < 10; ++second)
+            {
+                const auto start = second * sampleRate;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const auto note = 48 + (second * 7 + k * 4) % 24;
+                    sequence.addEvent (juce::MidiMessage::noteOn (1, note, 0.7f), start + 100.0 + k * 3000.0);
+                    sequence.addEvent (juce::MidiMessage::noteOff (1, note), start + 20000.0 + k * 3000.0);
+                }
+                sequence.addEvent (juce::MidiMessage::pitchWheel (1, second % 2 == 0 ? 12000 : 8192), start + 5000.0);
+            }
+            return sequence;
+        }
+
+        void setupProcessor (AudioPluginAudioProcessor& processor)
+        {
+            processor.getParameters().set (params::MainEnvelopeRelease, 0.02f);
+            processor.getParameters().set (params::MainUnisonVoices, 3.0f);
+        }
+    } // namespace
+
+    TEST(OfflineRenderer, ChunkedRenderMatchesSerialRender)
+    {
+        AudioPluginAudioProcessor processor {};
+        setupProcessor (processor);
+        const auto sequence = makeSequence();
+
+        OfflineRenderer<double> renderer (processor.getMainSineDouble(), fastmath::SineAccuracy::Exact, sampleRate, blockSize);
+
+        std::vector<double> serialLeft (numSamples), serialRight (numSamples);
+        renderer.render (sequence, serialLeft.data(), serialRight.data(), numSamples, 1);
+        ASSERT_EQ (renderer.getNumChunks(), 1);
+
+        std::vector<double> chunkedLeft (numSamples), chunkedRight (numSamples);
+        renderer.render (sequence, chunkedLeft.data(), chunkedRight.data(), numSamples, 4);
+        EXPECT_GT (renderer.getNumChunks(), 4);
+
+        EXPECT_EQ (serialLeft, chunkedLeft);
+        EXPECT_EQ (serialRight, chunkedRight);
+    }
+
+    TEST(OfflineRenderer, SerialRenderMatchesProcessor)
+    {
+        AudioPluginAudioProcessor processor {};
+        setupProcessor (processor);
+        const auto sequence = makeSequence();
+
+        OfflineRenderer<double> renderer (processor.getMainSineDouble(), fastmath::SineAccuracy::Exact, sampleRate, blockSize);
+        std::vector<double> left (numSamples), right (numSamples);
+        renderer.render (sequence, left.data(), right.data(), numSamples, 2);
+
+        processor.setProcessingPrecision (juce::AudioProcessor::doublePrecision);
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        juce::AudioBuffer<double> buffer (2, blockSize);
+        juce::MidiBuffer midi;
+        auto numEqual = 0;
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            midi.clear();
+            for (const auto* holder : sequence)
+            {
+                const auto time = holder->message.getTimeStamp();
+                if (time >= start && time < start + blockSize)
+                    midi.addEvent (holder->message, (int) time - start);
+            }
+
+            buffer.clear();
+            processor.processBlock (buffer, midi);
+            for (int i = 0; i < blockSize; ++i)
+            {
+                numEqual += buffer.getSample (0, i) == left[(size_t) (start + i)] && buffer.getSample (1, i) == right[(size_t) (start + i)];
+            }
+        }
+        EXPECT_EQ (numEqual, numSamples);
+    }
+
+    TEST(OfflineRenderer, CheckpointContinuesMidNote)
+    {
+        AudioPluginAudioProcessor processor {};
+        setupProcessor (processor);
+        auto& carrier = processor.getMainSineDouble();
+        ExpressionLanes expression;
+
+        VoiceBank<double> original (carrier, fastmath::SineAccuracy::Exact);
+        original.prepare (sampleRate, blockSize);
+        original.noteOn (60, 1.0f, 0);
+        original.noteOn (67, 0.5f, 0);
+
+        std::vector<double> first (blockSize), second (blockSize);
+        for (int block = 0; block < 10; ++block)
+        {
+            original.updateControl (expression, blockSize);
+            original.renderVoices (first.data(), nullptr, blockSize);
+        }
+
+        VoiceBank<double>::Checkpoint checkpoint;
+        original.getCheckpoint (checkpoint);
+
+        VoiceBank<double> restored (carrier, fastmath::SineAccuracy::Exact);
+        restored.prepare (sampleRate, blockSize);
+        restored.restoreCheckpoint (checkpoint);
+
+        for (int block = 0; block < 10; ++block)
+        {
+            original.updateControl (expression, blockSize);
+            original.renderVoices (first.data(), nullptr, blockSize);
+            restored.updateControl (expression, blockSize);
+            restored.renderVoices (second.data(), nullptr, blockSize);
+            ASSERT_EQ (first, second) << "block " << block;
+        }
+    }
+} // namespace audio_plugin_test
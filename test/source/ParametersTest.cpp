@@ -0,0 +1,32 @@
+#include <gtest/gtest.h>
+
+#include "PluginProcessor.h"
+
+namespace audio_plugin_test {
+    TEST(Parameters, RegistryResolvesEveryEntryAtItsDefault)
+    {
+        AudioPluginAudioProcessor processor {};
+        const auto& parameters = processor.getParameters();
+
+        for (const auto& spec : params::specs)
+        {
+            ASSERT_NE (parameters.getRawValue (spec.id), nullptr) << spec.key;
+            EXPECT_EQ (parameters.getParameter (spec.id).getParameterID(), juce::String (spec.key));
+            EXPECT_FLOAT_EQ (parameters.get (spec.id), spec.defaultValue) << spec.key;
+        }
+        EXPECT_EQ (parameters.getRawValue (params::None), nullptr);
+    }
+
+    TEST(Parameters, SetTakesPlainValues)
+    {
+        AudioPluginAudioProcessor processor {};
+        const auto& parameters = processor.getParameters();
+
+        parameters.set (params::MainModulationRatio, 3.0f);
+        EXPECT_NEAR (parameters.get (params::MainModulationRatio), 3.0f, 1.0e-5f);
+        EXPECT_NEAR (processor.getMainSine().getModulationRatio(), 3.0f, 1.0e-5f);
+
+        parameters.set (params::MainUnisonVoices, 4.0f);
+        EXPECT_EQ (processor.getMainSine().getUnisonVoices(), 4);
+    }
+} // namespace audio_plugin_test
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+#include "PluginProcessor.h"
+#include "Resynthesis.h"
+#include <chrono>
+#include <thread>
+
+namespace audio_plugin_test {
+    namespace
+    {
+        constexpr double sampleRate = 48000.0;
+
+        // carrier at frequency, phase modulated at ratio times it with index in radians
+        std::vector<float> makeFm (int numSamples, double frequency, double ratio, double index, float amplitude)
+        {
+            std::vector<float> samples ((size_t) numSamples);
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const auto t = juce::MathConstants<double>::twoPi * frequency * i / sampleRate;
+                samples[(size_t) i] = amplitude * (float) std::sin (t + index * std::sin (ratio * t));
+            }
+            return samples;
+        }
+    } // namespace
+
+    TEST(Resynthesis, BesselMatchesReferenceValues)
+    {
+        EXPECT_NEAR (resynthesis::besselJ (0, 1.0), 0.7651976866, 1.0e-9);
+        EXPECT_NEAR (resynthesis::besselJ (1, 2.0), 0.5767248078, 1.0e-9);
+        EXPECT_NEAR (resynthesis::besselJ (3, 5.0), 0.3648312306, 1.0e-9);
+        EXPECT_NEAR (resynthesis::besselJ (0, 2.404825557695773), 0.0, 1.0e-9);
+    }
+
+    TEST(Resynthesis, YinFindsThePitchOfAHarmonicTone)
+    {
+        const auto frame = makeFm (2048, 220.0, 1.0, 1.5, 0.5f);
+
+        auto aperiodicity = 1.0f;
+        const auto pitch = resynthesis::estimatePitch (frame.data(), 2048, sampleRate, 50.0, 2000.0, aperiodicity);
+
+        EXPECT_NEAR (pitch, 220.0f, 0.5f);
+        EXPECT_LT (aperiodicity, 0.05f);
+    }
+
+    TEST(Resynthesis, NoiseIsUnvoiced)
+    {
+        juce::Random random (1);
+        std::vector<float> noise (4096);
+        for (auto& sample : noise)
+            sample = random.nextFloat() - 0.5f;
+
+        resynthesis::Resynthesizer resynthesizer;
+        resynthesizer.prepare (sampleRate);
+        ASSERT_LE (resynthesizer.getFrameSize(), (int) noise.size());
+
+        const auto patch = resynthesizer.analyse (noise.data());
+        EXPECT_FALSE (patch.voiced);
+        EXPECT_GT (patch.level, 0.0f);
+    }
+
+    TEST(Resynthesis, FitRecoversTheFmPatch)
+    {
+        resynthesis::Resynthesizer resynthesizer;
+        resynthesizer.prepare (sampleRate);
+
+        // Ratio 2 only has odd harmonics, ratio 0.5 puts the carrier on the second harmonic of the pitch
+        struct Case
+        {
+            double frequency, ratio, index;
+        };
+        for (const auto& c : { Case { 200.0, 1.0, 2.0 }, Case { 150.0, 2.0, 1.5 }, Case { 400.0, 0.5, 3.0 } })
+        {
+            const auto frame = makeFm (resynthesizer.getFrameSize(), c.frequency, c.ratio, c.index, 0.4f);
+            const auto patch = resynthesizer.analyse (frame.data());
+
+            ASSERT_TRUE (patch.voiced) << c.frequency;
+            EXPECT_NEAR (patch.frequency, (float) c.frequency, 0.01f * (float) c.frequency);
+            EXPECT_FLOAT_EQ (patch.modulationRatio, (float) c.ratio);
+            EXPECT_NEAR (patch.modulationAmplitude * patch.modulationAmplitude, (float) c.index, 0.2f);
+            EXPECT_NEAR (patch.level, 0.4f, 0.02f);
+        }
+    }
+
+    TEST(Resynthesis, DoubleBufferNeverTears)
+    {
+        struct Value
+        {
+            std::array<int, 32> copies;
+        };
+        resynthesis::AtomicDoubleBuffer<Value> buffer;
+        std::atomic<bool> done { false };
+
+        std::thread writer ([&] {
+            Value value;
+            for (int k = 1; k <= 20000; ++k)
+            {
+                value.copies.fill (k);
+                buffer.publish (value);
+            }
+            done = true;
+        });
+
+        auto last = 0;
+        while (! done)
+        {
+            const auto value = buffer.read();
+            for (auto copy : value.copies)
+                ASSERT_EQ (copy, value.copies.front());
+            EXPECT_GE (value.copies.front(), last);
+            last = value.copies.front();
+        }
+        writer.join();
+        EXPECT_EQ (buffer.read().copies.front(), 20000);
+    }
+
+    TEST(Resynthesis, WorkerPublishesPatchesFromQueuedInput)
+    {
+        resynthesis::Resynthesizer resynthesizer;
+        resynthesizer.prepare (sampleRate);
+        resynthesizer.setRunning (true);
+
+        const auto input = makeFm (2 * resynthesizer.getFrameSize(), 330.0, 1.0, 1.0, 0.3f);
+        juce::AudioBuffer<float> block (2, 256);
+        for (int start = 0; start + 256 <= (int) input.size(); start += 256)
+        {
+            block.copyFrom (0, 0, input.data() + start, 256);
+            block.copyFrom (1, 0, input.data() + start, 256);
+            resynthesizer.pushInput (block, 2);
+        }
+
+        auto patch = resynthesizer.getLatestPatch();
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds (5);
+        while (! patch.voiced && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for (std::chrono::milliseconds (5));
+            patch = resynthesizer.getLatestPatch();
+        }
+
+        ASSERT_TRUE (patch.voiced);
+        EXPECT_NEAR (patch.frequency, 330.0f, 2.0f);
+        EXPECT_EQ (resynthesizer.getNumDroppedSamples(), 0);
+
+        // Turning the mode off forgets the patch, so turning it back on doesn't replay it
+        resynthesizer.setRunning (false);
+        EXPECT_FALSE (resynthesizer.isRunning());
+        EXPECT_FALSE (resynthesizer.getLatestPatch().voiced);
+        resynthesizer.setRunning (true);
+        EXPECT_FALSE (resynthesizer.getLatestPatch().voiced);
+    }
+
+    TEST(Resynthesis, AnalysisOnlyRunsWhileEnabled)
+    {
+        AudioPluginAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails (sampleRate, 512);
+        processor.prepareToPlay (sampleRate, 512);
+        EXPECT_FALSE (processor.getResynthesizer().isRunning());
+        processor.releaseResources();
+
+        processor.getParameters().set (params::ResynthesisEnabled, 1.0f);
+        processor.prepareToPlay (sampleRate, 512);
+        EXPECT_TRUE (processor.getResynthesizer().isRunning());
+        processor.releaseResources();
+        EXPECT_FALSE (processor.getResynthesizer().isRunning());
+    }
+
+    TEST(Resynthesis, ProcessorReplacesItsInputWithTheTrackedNote)
+    {
+        AudioPluginAudioProcessor processor;
+        processor.getParameters().set (params::ResynthesisEnabled, 1.0f);
+        processor.setRateAndBufferSizeDetails (sampleRate, 512);
+        processor.prepareToPlay (sampleRate, 512);
+
+        const auto input = makeFm (10 * (int) sampleRate, 220.0, 1.0, 0.0, 0.5f);
+        juce::AudioBuffer<float> buffer (2, 512);
+        juce::MidiBuffer midi;
+
+        // Until the analysis thread has a patch the output is silent, after that the tracked note plays
+        auto peak = 0.0f;
+        for (int start = 0; peak == 0.0f && start + 512 <= (int) input.size(); start += 512)
+        {
+            for (int channel = 0; channel < 2; ++channel)
+                buffer.copyFrom (channel, 0, input.data() + start, 512);
+
+            processor.processBlock (buffer, midi);
+            peak = buffer.getMagnitude (0, 0, 512);
+            std::this_thread::sleep_for (std::chrono::milliseconds (2));
+        }
+
+        EXPECT_GT (peak, 0.0f);
+        EXPECT_EQ (processor.getVoices().getNumActiveVoices(), (int) processor.getParameters().get (params::MainUnisonVoices));
+        processor.releaseResources();
+    }
+} // namespace audio_plugin_test
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "PluginProcessor.h"
+#include "TimbreIndex.h"
+
+namespace audio_plugin_test {
+    namespace
+    {
+        std::vector<float> makeUnitEmbedding (int hotBand)
+        {
+            std::vector<float> embedding ((size_t) timbre::embeddingSize, 0.0f);
+            embedding[(size_t) hotBand] = 1.0f;
+            return embedding;
+        }
+
+        std::unique_ptr<juce::XmlElement> makePreset (float modulationRatio)
+        {
+            AudioPluginAudioProcessor processor;
+            auto* parameter = processor.getAPVTS().getParameter ("main_modulation_ratio");
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (modulationRatio));
+            return processor.getAPVTS().copyState().createXml();
+        }
+
+        float dot (const float* a, const float* b)
+        {
+            float sum = 0.0f;
+            for (int i = 0; i < timbre::embeddingSize; ++i)
+                sum += a[i] * b[i];
+            return sum;
+        }
+    } // namespace
+
+    TEST(TimbreIndex, SaveLoadRoundTripAndQueryOrder)
+    {
+        timbre::Index index;
+        for (int band = 0; band < 8; ++band)
+            index.add ("preset " + juce::String (band), makeUnitEmbedding (band).data());
+
+        const auto file = juce::File::createTempFile ("index");
+        ASSERT_TRUE (index.save (file));
+
+        timbre::Index loaded;
+        ASSERT_TRUE (loaded.load (file));
+        file.deleteFile();
+        ASSERT_EQ (loaded.size(), 8);
+
+        // Between bands 3 and 5, slightly closer to 5
+        auto query = makeUnitEmbedding (5);
+        query[3] = 0.8f;
+        const auto matches = loaded.query (query.data(), 3);
+
+        ASSERT_EQ (matches.size(), 3u);
+        EXPECT_EQ (matches[0].name, "preset 5");
+        EXPECT_EQ (matches[1].name, "preset 3");
+        EXPECT_FLOAT_EQ (matches[0].similarity, 1.0f);
+        EXPECT_FLOAT_EQ (matches[2].similarity, 0.0f);
+    }
+
+    TEST(TimbreIndex, RejectsMissingFile)
+    {
+        timbre::Index index;
+        EXPECT_FALSE (index.load (juce::File::getNonexistentFile()));
+        EXPECT_EQ (index.size(), 0);
+        EXPECT_TRUE (index.query (makeUnitEmbedding (0).data(), 5).empty());
+    }
+
+    TEST(TimbreIndex, RejectsCountBeyondTheFile)
+    {
+        timbre::Index index;
+        index.add ("preset", makeUnitEmbedding (0).data());
+
+        const auto file = juce::File::createTempFile ("index");
+        ASSERT_TRUE (index.save (file));
+
+        // Magic, version and embedding size, then the count: claim far more presets than the file holds
+        juce::MemoryBlock data;
+        ASSERT_TRUE (file.loadFileAsData (data));
+        const auto hugeCount = juce::ByteOrder::swapIfBigEndian ((juce::uint32) 0x7fffffff);
+        data.copyFrom (&hugeCount, 3 * (int) sizeof (juce::int32), sizeof (hugeCount));
+        ASSERT_TRUE (file.replaceWithData (data.getData(), data.getSize()));
+
+        timbre::Index loaded;
+        EXPECT_FALSE (loaded.load (file));
+        EXPECT_EQ (loaded.size(), 0);
+        file.deleteFile();
+    }
+
+    TEST(TimbreIndex, EmbeddingsSeparateDifferentTimbres)
+    {
+        const auto reference = makePreset (1.0f);
+        const auto same = makePreset (1.0f);
+        const auto other = makePreset (7.0f);
+
+        // One renderer for all three, like an indexer worker: other between the two equal presets checks
+        // that a render doesn't depend on the preset before it
+        timbre::PresetRenderer renderer;
+        const std::vector<std::vector<float>> renders { renderer.render (*reference), renderer.render (*other), renderer.render (*same) };
+        const auto embeddings = timbre::computeEmbeddings (renders);
+        ASSERT_EQ (embeddings.size(), (size_t) (3 * timbre::embeddingSize));
+
+        const auto* a = embeddings.data();
+        const auto* c = a + timbre::embeddingSize;
+        const auto* b = c + timbre::embeddingSize;
+
+        EXPECT_NEAR (dot (a, a), 1.0f, 1.0e-4f);
+        EXPECT_NEAR (dot (a, b), 1.0f, 1.0e-4f);
+        EXPECT_LT (dot (a, c), dot (a, b) - 0.01f);
+    }
+} // namespace audio_plugin_test
@@ -0,0 +1,280 @@
+#include <gtest/gtest.h>
+
+#include "PluginProcessor.h"
+#include <algorithm>
+#include <vector>
+
+namespace audio_plugin_test {
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+
+    void setParameter (AudioPluginAudioProcessor& processor, const char* parameterID, float normalisedValue)
+    {
+        processor.getAPVTS().getParameter (parameterID)->setValueNotifyingHost (normalisedValue);
+    }
+
+    // Without an envelope a single voice renders a plain two operator FM tone, after the first control
+    // interval (the voice fades in over it). The reference keeps the same fixed-point phases.
+    TEST(VoiceBank, SingleVoiceMatchesReference)
+    {
+        AudioPluginAudioProcessor processor {};
+        setParameter (processor, "main_envelope_enabled", 0.0f);
+
+        auto& signal = processor.getMainSineDouble();
+        VoiceBank<double> bank (signal, fastmath::SineAccuracy::Exact);
+        bank.prepare (sampleRate, blockSize);
+        bank.noteOn (69, 1.0f, 0);
+
+        const auto frequency = juce::MidiMessage::getMidiNoteInHertz (69);
+        const auto carrierIncrement = phase::incrementForFrequency (frequency, sampleRate);
+        const auto modulatorIncrement = phase::incrementForFrequency (frequency * signal.getModulationRatio(), sampleRate);
+        const auto modulationAmplitude = signal.getModulation().isEnabled() ? signal.getModulation().getAmplitude() : 0.0;
+        phase::Accumulator carrierPhase = 0, modulatorPhase = 0;
+
+        ExpressionLanes expression;
+        std::vector<double> voices (blockSize);
+        for (int block = 0; block < 4; ++block)
+        {
+            bank.updateControl (expression, blockSize);
+            bank.renderVoices (voices.data(), nullptr, blockSize);
+
+            for (int i = 0; i < blockSize; ++i)
+            {
+                const auto modulation = modulationAmplitude * modulationAmplitude * std::sin (phase::toRadians<double> (modulatorPhase));
+                const auto reference = signal.getAmplitude() * std::sin (phase::toRadians<double> (carrierPhase) + modulation);
+                carrierPhase += carrierIncrement;
+                modulatorPhase += modulatorIncrement;
+
+                if (block > 0 || i >= VoiceBank<double>::controlInterval)
+                    ASSERT_NEAR (voices[(size_t) i], reference, 1.0e-9) << "block " << block << " sample " << i;
+            }
+        }
+    }
+
+    // A voice still ringing when the host changes the sample rate continues at the same pitch, with the
+    // increments of the new rate from the next control update on.
+    TEST(VoiceBank, RingingVoiceKeepsItsPitchAcrossSampleRateChange)
+    {
+        AudioPluginAudioProcessor processor {};
+        setParameter (processor, "main_envelope_enabled", 0.0f);
+
+        auto& signal = processor.getMainSineDouble();
+        VoiceBank<double> bank (signal, fastmath::SineAccuracy::Exact);
+        bank.prepare (sampleRate, blockSize);
+        bank.noteOn (69, 1.0f, 0);
+
+        const auto frequency = juce::MidiMessage::getMidiNoteInHertz (69);
+        const auto modulationAmplitude = signal.getModulation().isEnabled() ? signal.getModulation().getAmplitude() : 0.0;
+        phase::Accumulator carrierPhase = 0, modulatorPhase = 0;
+
+        ExpressionLanes expression;
+        std::vector<double> voices (blockSize);
+        for (int block = 0; block < 4; ++block)
+        {
+            const auto rate = block < 2 ? sampleRate : 2.0 * sampleRate;
+            if (block == 2)
+                bank.prepare (rate, blockSize);
+
+            const auto carrierIncrement = phase::incrementForFrequency (frequency, rate);
+            const auto modulatorIncrement = phase::incrementForFrequency (frequency * signal.getModulationRatio(), rate);
+            bank.updateControl (expression, blockSize);
+            bank.renderVoices (voices.data(), nullptr, blockSize);
+
+            for (int i = 0; i < blockSize; ++i)
+            {
+                const auto modulation = modulationAmplitude * modulationAmplitude * std::sin (phase::toRadians<double> (modulatorPhase));
+                const auto reference = signal.getAmplitude() * std::sin (phase::toRadians<double> (carrierPhase) + modulation);
+                carrierPhase += carrierIncrement;
+                modulatorPhase += modulatorIncrement;
+
+                if (block > 0)
+                    ASSERT_NEAR (voices[(size_t) i], reference, 1.0e-9) << "block " << block << " sample " << i;
+            }
+        }
+    }
+
+    TEST(VoiceBank, VoicesAreFreedAfterRelease)
+    {
+        AudioPluginAudioProcessor processor {};
+        VoiceBank<float> bank (processor.getMainSine(), fastmath::SineAccuracy::Precise);
+        bank.prepare (sampleRate, blockSize);
+
+        ExpressionLanes expression;
+        std::vector<float> output (blockSize);
+        bank.noteOn (60, 1.0f, 0);
+        bank.noteOn (64, 1.0f, 0);
+        bank.noteOn (64, 1.0f, 1);
+        EXPECT_EQ (bank.getNumActiveVoices(), 3);
+
+        bank.noteOff (64, 0);
+        bank.updateControl (expression, blockSize);
+        bank.renderVoices (output.data(), nullptr, blockSize);
+        EXPECT_EQ (bank.getNumActiveVoices(), 3);
+
+        // The default release of 0.1 s takes about 1.4 s to fall below the silence threshold
+        bank.allNotesOff();
+        for (int block = 0; block < 2 * (int) sampleRate / blockSize && bank.isActive(); ++block)
+        {
+            bank.updateControl (expression, blockSize);
+            bank.renderVoices (output.data(), nullptr, blockSize);
+        }
+        EXPECT_FALSE (bank.isActive());
+    }
+
+    TEST(VoiceBank, StealsOldestVoiceWhenFull)
+    {
+        AudioPluginAudioProcessor processor {};
+        VoiceBank<float> bank (processor.getMainSine(), fastmath::SineAccuracy::Fast);
+        bank.prepare (sampleRate, blockSize);
+
+        for (int note = 0; note < VoiceBank<float>::maxVoices + 2; ++note)
+            bank.noteOn (note, 1.0f, 0);
+        EXPECT_EQ (bank.getNumActiveVoices(), VoiceBank<float>::maxVoices);
+
+        // Notes 0 and 1 were stolen, so releasing them frees nothing
+        bank.noteOff (0, 0);
+        bank.noteOff (1, 0);
+        ExpressionLanes expression;
+        std::vector<float> output (blockSize);
+        bank.updateControl (expression, blockSize);
+        bank.renderVoices (output.data(), nullptr, blockSize);
+        bank.updateControl (expression, blockSize);
+        EXPECT_EQ (bank.getNumActiveVoices(), VoiceBank<float>::maxVoices);
+    }
+
+    // The stolen voice keeps sounding for one control interval while it fades, instead of stopping dead
+    TEST(VoiceBank, StolenVoiceFadesOut)
+    {
+        AudioPluginAudioProcessor processor {};
+        setParameter (processor, "main_envelope_enabled", 0.0f);
+        setParameter (processor, "main_mod_enabled", 0.0f);
+        VoiceBank<float> bank (processor.getMainSine(), fastmath::SineAccuracy::Precise);
+        bank.prepare (sampleRate, blockSize);
+
+        // Only the oldest voice is audible, the rest just fill the bank
+        bank.noteOn (69, 1.0f, 0);
+        for (int note = 1; note < VoiceBank<float>::maxVoices; ++note)
+            bank.noteOn (note, 0.0f, 0);
+
+        ExpressionLanes expression;
+        std::vector<float> output (blockSize);
+        bank.updateControl (expression, blockSize);
+        bank.renderVoices (output.data(), nullptr, blockSize);
+        const auto lastSample = output.back();
+
+        bank.noteOn (100, 0.0f, 0);
+        EXPECT_EQ (bank.getNumActiveVoices(), VoiceBank<float>::maxVoices);
+        EXPECT_FALSE (bank.isSilent());
+        bank.updateControl (expression, blockSize);
+        bank.renderVoices (output.data(), nullptr, blockSize);
+
+        // A 440 Hz sine moves by less than 0.06 of its amplitude per sample at 48 kHz
+        const auto amplitude = processor.getMainSine().getAmplitude();
+        EXPECT_LT (std::abs (output.front() - lastSample), 0.06f * amplitude);
+        for (int i = 1; i < VoiceBank<float>::controlInterval; ++i)
+            EXPECT_LE (std::abs (output[(size_t) i]), amplitude * (float) (VoiceBank<float>::controlInterval - i + 1) / VoiceBank<float>::controlInterval);
+        for (int i = VoiceBank<float>::controlInterval; i < blockSize; ++i)
+            ASSERT_NEAR (output[(size_t) i], 0.0f, 1.0e-6f) << i;
+    }
+
+    // A note on another channel keeps the patch while the override silences the notes on its own channel
+    TEST(VoiceBank, PatchOverrideOnlyAppliesToItsExpressionVoice)
+    {
+        AudioPluginAudioProcessor processor {};
+        ExpressionLanes expression;
+        const auto render = [&] (bool withOverriddenNote) {
+            VoiceBank<float> bank (processor.getMainSine(), fastmath::SineAccuracy::Precise);
+            bank.prepare (sampleRate, blockSize);
+            bank.setPatchOverride (VoiceBank<float>::PatchOverride { 0.0f, 1.0f, 3.0, 15 });
+            bank.noteOn (60, 1.0f, 0);
+            if (withOverriddenNote)
+                bank.noteOn (67, 1.0f, 15);
+
+            std::vector<float> output (blockSize);
+            bank.updateControl (expression, blockSize);
+            bank.renderVoices (output.data(), nullptr, blockSize);
+            return output;
+        };
+
+        const auto played = render (false);
+        EXPECT_GT (*std::max_element (played.begin(), played.end()), 0.0f);
+        EXPECT_EQ (render (true), played);
+    }
+
+    TEST(VoiceBank, UnisonSpreadsCopiesAcrossStereo)
+    {
+        AudioPluginAudioProcessor processor {};
+        auto& apvts = processor.getAPVTS();
+        setParameter (processor, "main_unison_voices", apvts.getParameterRange ("main_unison_voices").convertTo0to1 (4.0f));
+
+        VoiceBank<float> bank (processor.getMainSine(), fastmath::SineAccuracy::Precise);
+        bank.prepare (sampleRate, blockSize);
+        bank.noteOn (60, 1.0f, 0);
+        EXPECT_EQ (bank.getNumActiveVoices(), 4);
+
+        ExpressionLanes expression;
+        std::vector<float> left (blockSize), right (blockSize);
+        bank.updateControl (expression, blockSize);
+        ASSERT_TRUE (bank.isStereo());
+        bank.renderVoices (left.data(), right.data(), blockSize);
+
+        auto difference = 0.0f;
+        for (int i = 0; i < blockSize; ++i)
+            difference = juce::jmax (difference, std::abs (left[(size_t) i] - right[(size_t) i]));
+        EXPECT_GT (difference, 1.0e-3f);
+
+        // Without spread the copies stay centred and the bank renders mono
+        setParameter (processor, "main_unison_spread", 0.0f);
+        bank.updateControl (expression, blockSize);
+        EXPECT_FALSE (bank.isStereo());
+
+        bank.noteOff (60, 0);
+        setParameter (processor, "main_unison_voices", 0.0f);
+        bank.noteOn (62, 1.0f, 0);
+        EXPECT_EQ (bank.getNumActiveVoices(), 5);
+    }
+
+    // Copies are scaled for an incoherent sum, so at the same detune they must not start in phase, and
+    // without detune they fold into a single voice instead of playing it louder
+    TEST(VoiceBank, UnisonKeepsTheLoudnessOfOneVoice)
+    {
+        AudioPluginAudioProcessor processor {};
+        auto& apvts = processor.getAPVTS();
+        setParameter (processor, "main_envelope_enabled", 0.0f);
+        setParameter (processor, "main_unison_spread", 0.0f);
+
+        const auto renderRms = [&] (int unisonVoices, float detune, int& numVoices) {
+            setParameter (processor, "main_unison_voices", apvts.getParameterRange ("main_unison_voices").convertTo0to1 ((float) unisonVoices));
+            setParameter (processor, "main_unison_detune", apvts.getParameterRange ("main_unison_detune").convertTo0to1 (detune));
+
+            VoiceBank<float> bank (processor.getMainSine(), fastmath::SineAccuracy::Precise);
+            bank.prepare (sampleRate, blockSize);
+            bank.noteOn (69, 1.0f, 0);
+            numVoices = bank.getNumActiveVoices();
+
+            ExpressionLanes expression;
+            std::vector<float> output (blockSize);
+            auto sum = 0.0;
+            for (int block = 0; block < 16; ++block)
+            {
+                bank.updateControl (expression, blockSize);
+                bank.renderVoices (output.data(), nullptr, blockSize);
+                for (auto sample : output)
+                    sum += (double) sample * sample;
+            }
+            return std::sqrt (sum / (16 * blockSize));
+        };
+
+        auto numVoices = 0;
+        const auto single = renderRms (1, 0.0f, numVoices);
+        ASSERT_GT (single, 0.1);
+
+        const auto folded = renderRms (8, 0.0f, numVoices);
+        EXPECT_EQ (numVoices, 1);
+        EXPECT_NEAR (folded, single, 1.0e-6);
+
+        const auto detuned = renderRms (8, 25.0f, numVoices);
+        EXPECT_EQ (numVoices, 8);
+        EXPECT_NEAR (juce::Decibels::gainToDecibels (detuned / single), 0.0, 3.0);
+    }
+}
@@ -0,0 +1,146 @@
+// Builds and queries the timbre similarity index over a preset library.
+//
+//   TimbreIndexer build <presetDirectory> [indexFile]
+//   TimbreIndexer query <preset.xml> [indexFile] [numResults]
+//
+// Presets are the plugin's state files (APVTS XML), searched recursively. The index file defaults to
+// timbre::Index::getDefaultFile(), which is where the plugin looks for it.
+
+#include "TimbreIndex.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    // Renders per embedding batch, large enough to keep every core busy in the STFT
+    constexpr size_t batchSize = 256;
+
+    juce::File getIndexFile (const juce::StringArray& args, int position)
+    {
+        if (args.size() > position)
+            return juce::File::getCurrentWorkingDirectory().getChildFile (args[position]);
+        return timbre::Index::getDefaultFile();
+    }
+
+    // Renders are independent, each worker owns one renderer and reuses it for all its presets
+    std::vector<std::vector<float>> renderPresets (const std::vector<std::unique_ptr<juce::XmlElement>>& states)
+    {
+        std::vector<std::vector<float>> renders (states.size());
+        std::atomic<size_t> next { 0 };
+
+        const auto numThreads = (size_t) juce::jmax (1, juce::SystemStats::getNumCpus());
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < juce::jmin (numThreads, states.size()); ++t)
+        {
+            workers.emplace_back ([&] {
+                timbre::PresetRenderer renderer;
+                for (auto i = next++; i < states.size(); i = next++)
+                    renders[i] = renderer.render (*states[i]);
+            });
+        }
+        for (auto& worker : workers)
+            worker.join();
+
+        return renders;
+    }
+
+    int build (const juce::File& directory, const juce::File& indexFile)
+    {
+        if (! directory.isDirectory())
+        {
+            std::cerr << "Not a directory: " << directory.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        const auto files = directory.findChildFiles (juce::File::findFiles, true, "*.xml");
+        const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        timbre::Index index;
+        for (size_t start = 0; start < (size_t) files.size(); start += batchSize)
+        {
+            std::vector<std::unique_ptr<juce::XmlElement>> states;
+            juce::StringArray names;
+            for (auto i = start; i < juce::jmin (start + batchSize, (size_t) files.size()); ++i)
+            {
+                const auto& file = files.getReference ((int) i);
+                auto state = juce::XmlDocument::parse (file);
+                if (state == nullptr)
+                {
+                    std::cerr << "Skipping unreadable preset " << file.getFullPathName() << std::endl;
+                    continue;
+                }
+                states.push_back (std::move (state));
+                names.add (file.getRelativePathFrom (directory).upToLastOccurrenceOf (".", false, false));
+            }
+
+            const auto embeddings = timbre::computeEmbeddings (renderPresets (states));
+            for (int i = 0; i < names.size(); ++i)
+                index.add (names[i], embeddings.data() + (size_t) i * timbre::embeddingSize);
+
+            std::cout << "Indexed " << index.size() << " / " << files.size() << " presets\r" << std::flush;
+        }
+
+        if (! index.save (indexFile))
+        {
+            std::cerr << "\nCould not write " << indexFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        const auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+        std::cout << "\nWrote " << index.size() << " presets to " << indexFile.getFullPathName() << " in " << seconds << " s"
+                  << std::endl;
+        return 0;
+    }
+
+    int query (const juce::File& presetFile, const juce::File& indexFile, int numResults)
+    {
+        const auto state = juce::XmlDocument::parse (presetFile);
+        if (state == nullptr)
+        {
+            std::cerr << "Could not read preset " << presetFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        timbre::Index index;
+        if (! index.load (indexFile))
+        {
+            std::cerr << "Could not read index " << indexFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        const auto embedding = timbre::computeEmbeddings ({ timbre::PresetRenderer().render (*state) });
+
+        const auto startTime = juce::Time::getMillisecondCounterHiRes();
+        const auto matches = index.query (embedding.data(), numResults);
+        const auto milliseconds = juce::Time::getMillisecondCounterHiRes() - startTime;
+
+        for (const auto& match : matches)
+            std::cout << match.similarity << "\t" << match.name << std::endl;
+        std::cout << "Searched " << index.size() << " presets in " << milliseconds << " ms" << std::endl;
+        return 0;
+    }
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add (argv[i]);
+
+    const auto cwd = juce::File::getCurrentWorkingDirectory();
+
+    if (args.size() >= 2 && args[0] == "build")
+        return build (cwd.getChildFile (args[1]), getIndexFile (args, 2));
+
+    if (args.size() >= 2 && args[0] == "query")
+        return query (cwd.getChildFile (args[1]), getIndexFile (args, 2), args.size() > 3 ? args[3].getIntValue() : 10);
+
+    std::cerr << "Usage: TimbreIndexer build <presetDirectory> [indexFile]\n"
+                 "       TimbreIndexer query <preset.xml> [indexFile] [numResults]"
+              << std::endl;
+    return 1;
+}